@@ -53,6 +53,8 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -65,6 +67,11 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Writes consecutive sectors from BUFFERS, one
+       BLOCK_SECTOR_SIZE buffer per sector. */
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffers[]);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -50,6 +50,11 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* Most sectors a single READ/WRITE SECTOR command can transfer.
+   A count of 0 in the Sector Count register means 256, but we
+   stick to counts that fit as-is. */
+#define IDE_MAX_SECTORS 255
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -86,6 +91,7 @@ static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
 static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -376,10 +382,52 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   lock_release (&c->lock);
 }
 
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D,
+   taking the data for each sector from the corresponding element
+   of BUFFERS.  Each command transfers up to IDE_MAX_SECTORS
+   sectors, so the disk is only selected and addressed once per
+   run.  Returns after the disk has acknowledged receiving all of
+   the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffers[])
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  size_t i, n;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      n = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+      select_sectors (d, sec_no, n);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+
+      /* The disk raises DRQ for each sector in turn and interrupts
+         once it has taken each one. */
+      for (i = 0; i < n; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          output_sector (c, buffers[i]);
+          sema_down (&c->completion_wait);
+        }
+
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
@@ -387,13 +435,23 @@ static struct block_operations ide_operations =
    use LBA mode.) */
 static void
 select_sector (struct ata_disk *d, block_sector_t sec_no)
+{
+  select_sectors (d, sec_no, 1);
+}
+
+/* Selects device D, waiting for it to become ready, and then
+   writes SEC_NO and the sector count CNT, which must be between
+   1 and IDE_MAX_SECTORS, to the disk's selection registers. */
+static void
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= IDE_MAX_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
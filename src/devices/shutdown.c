@@ -11,6 +11,7 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/buffercache.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -122,6 +123,7 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  buffercache_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -1,59 +1,133 @@
 #include <debug.h>
+#include <hash.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "filesys/buffercache.h"
+#include "filesys/cache-policy.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
- /* 30 second buffercache flush frequency */
-#define BUFFERCACHE_FLUSH_FREQUENCY 30 * 1000
+ /* The cleaner runs every second, writing back blocks that have been dirty
+    for 5 seconds, or every dirty block once half the cache is dirty */
+#define BUFFERCACHE_CLEAN_FREQUENCY 1000
+#define BUFFERCACHE_DIRTY_AGE (5 * TIMER_FREQ)
+#define BUFFERCACHE_DIRTY_RATIO 2
+
+/* Sectors released in the free map are published as free on disk at most
+   this often, since doing so flushes the whole cache first */
+#define BUFFERCACHE_FREE_MAP_AGE (5 * TIMER_FREQ)
+
+/* Maximum number of sectors waiting to be read ahead */
+#define BUFFERCACHE_READAHEAD_SIZE 32
 
 /**
- * List entry for a sector readahead action
+ * A bucket of the sector index. Entries are chained on ENTRIES by the sector
+ * they currently hold and on CLAIMS by the sector they are being loaded with.
  */
-struct readahead_entry
+struct cache_bucket
 {
-  block_sector_t sector;        /* Sector to read ahead */
-  struct list_elem elem;        /* List element */
+  struct lock lock;             /* Protects both lists */
+  struct list entries;          /* Entries keyed by sector */
+  struct list claims;           /* Entries keyed by next_sector */
 };
 
+/**
+ * A dirty entry gathered by buffercache_flush(), with the sector it held when
+ * it was gathered and the state to restore once it has been written.
+ */
+struct flush_item
+{
+  struct cache_entry *entry;    /* Entry to write */
+  block_sector_t sector;        /* Sector the entry held */
+  bool free_map;                /* Entry is a free map sector */
+  enum cache_state old_state;   /* State before the write */
+};
+
+
 static struct cache_entry *cache;      /* Cache entry table */
-static struct lock cache_lock;         /* Lock for entry table */
-static struct condition entries_ready; /* Signal for clock algorithm if no
-                                        * blocks available */
+static const struct cache_policy *policy; /* Replacement policy */
+static struct lock policy_lock;        /* Lock for the replacement policy */
+static struct condition entries_ready; /* Signal for replacement policy if
+                                        * no blocks available */
 static int cache_size;                 /* Size of the cache */
-static int clock_hand;                 /* For clock algorithm */
-static struct list readahead_list;     /* List of readahead blocks */
-static struct lock readahead_lock;     /* Protects readahead_list */
-static struct condition readahead_data; /* Notifies for readahead_list */
-
-static void buffercache_flush_thread (void *aux);
+static int dirty_cnt;                  /* Number of dirty entries */
+static bool clean_requested;           /* Cleaner has been asked to run */
+static struct lock cleaner_lock;       /* Protects dirty_cnt and
+                                        * clean_requested */
+static struct condition cleaner_wake;  /* Wakes the cleaner */
+static struct cache_bucket *buckets;   /* Sector index into cache */
+static unsigned bucket_mask;           /* Number of buckets minus one */
+static block_sector_t readahead_ring[BUFFERCACHE_READAHEAD_SIZE];
+                                       /* Sectors to read ahead */
+static int readahead_head;             /* Oldest sector in readahead_ring */
+static int readahead_cnt;              /* Sectors in readahead_ring */
+static struct lock readahead_lock;     /* Protects readahead_ring */
+static struct condition readahead_data; /* Notifies for readahead_ring */
+static struct cache_stats stats;       /* Counters, see buffercache_stat() */
+
+static void buffercache_cleaner_thread (void *aux);
+static void buffercache_cleaner_tick_thread (void *aux);
+static void buffercache_request_clean (void);
+static void buffercache_write_back (const int64_t dirtied_before,
+                                    const block_sector_t owner);
+static bool buffercache_mark_accessed (struct cache_entry *entry,
+                                       enum cache_accessed bits);
+static void buffercache_count_dirty (const int delta);
 static void buffercache_readahead_thread (void *aux);
 static void buffercache_allocate_block (struct cache_entry *entry, void *kaddr);
-static struct cache_entry *buffercache_find_entry (const block_sector_t sector);
-static struct cache_entry *buffercache_replace (const block_sector_t
-                                                sector, enum sector_type type);
+static struct cache_entry *buffercache_get_entry (const block_sector_t sector,
+                                                  enum sector_type type,
+                                                  enum cache_accessed bits,
+                                                  const void *fill);
+static void buffercache_release_entry (struct cache_entry *entry);
+static struct cache_entry *buffercache_find_entry (const block_sector_t sector,
+                                                   enum cache_accessed bits);
+static inline struct cache_bucket *buffercache_bucket (const block_sector_t
+                                                       sector);
+static struct cache_entry *buffercache_index_lookup (struct cache_bucket *b,
+                                                     const block_sector_t
+                                                     sector);
+static struct cache_entry *buffercache_replace (const block_sector_t sector,
+                                                enum sector_type type,
+                                                enum cache_accessed bits,
+                                                const void *fill);
 static int buffercache_read_direct (const block_sector_t sector,
                                     const int sector_ofs, const off_t size,
                                     void *buf);
 static int buffercache_write_direct (const block_sector_t sector,
                                      const int sector_ofs, const off_t size,
                                      const void *buf);
-static void buffercache_readahead_if_necessary (const block_sector_t sector);
 static void buffercache_load_entry (struct cache_entry *entry,
                                     const block_sector_t sector,
-                                    enum sector_type type);
+                                    enum sector_type type,
+                                    enum cache_accessed bits,
+                                    const void *fill);
 static void buffercache_flush_entry (struct cache_entry *entry,
                                      const bool await);
-static struct cache_entry *buffercache_clock_algorithm (void);
-static inline int buffercache_clock_next (void);
+static bool buffercache_begin_write (struct cache_entry *entry,
+                                     const block_sector_t sector,
+                                     enum cache_state *old_state,
+                                     const bool wait);
+static void buffercache_end_write (struct cache_entry *entry,
+                                   enum cache_state old_state);
+static void buffercache_await_write (struct cache_entry *entry);
+static int buffercache_flush_item_cmp (const void *a, const void *b);
+static struct cache_entry *buffercache_victim (void);
+static void buffercache_unclaim (struct cache_entry *entry);
+static void buffercache_signal_entries_ready (void);
+static void buffercache_wait (struct condition *cond,
+                              struct cache_entry *entry);
+static inline void buffercache_stat (uint64_t *counter, const int64_t n);
 
 /**
  * Initializes the buffer cache system. Returns true on success, false on
@@ -63,8 +137,9 @@ bool
 buffercache_init (const size_t size)
 {
   int i;
+  unsigned bucket_cnt;
   void *kaddr;
-  tid_t t_writer, t_reader;
+  tid_t t_writer, t_ticker, t_reader;
 
   /* Set the cache size */
   cache_size = size;
@@ -72,8 +147,25 @@ buffercache_init (const size_t size)
   /* Initialize list of pages */
   cache = malloc (cache_size * sizeof (struct cache_entry));
   if (cache == NULL) return false;
-  lock_init (&cache_lock);
+  lock_init (&policy_lock);
   cond_init (&entries_ready);
+  dirty_cnt = 0;
+  clean_requested = false;
+  lock_init (&cleaner_lock);
+  cond_init (&cleaner_wake);
+
+  /* Size the sector index to a power of two no smaller than the cache */
+  for (bucket_cnt = 1; bucket_cnt < size; bucket_cnt <<= 1)
+    continue;
+  bucket_mask = bucket_cnt - 1;
+  buckets = malloc (bucket_cnt * sizeof (struct cache_bucket));
+  if (buckets == NULL) return false;
+  for (i = 0; i < (int) bucket_cnt; i++)
+  {
+    lock_init (&buckets[i].lock);
+    list_init (&buckets[i].entries);
+    list_init (&buckets[i].claims);
+  }
 
   /* Allocate the cache pages */
   for (i = 0; i < cache_size; i++)
@@ -90,16 +182,24 @@ buffercache_init (const size_t size)
     buffercache_allocate_block (&cache[i], kaddr);
   }
 
-  /* Initialize the clock hand so first access will be slot 0 */
-  clock_hand = cache_size - 1;
+  /* Set up the replacement policy */
+  if (policy == NULL)
+    policy = cache_policy_lookup ("clock");
+  if (!policy->init (cache, cache_size)) return false;
 
   /* Create the buffercache flush thread */
-  t_writer = thread_create ("buffercache_flush", PRI_DEFAULT,
-                            thread_get_cwd (), buffercache_flush_thread, NULL);
+  t_writer = thread_create ("buffercache_clean", PRI_DEFAULT,
+                            thread_get_cwd (), buffercache_cleaner_thread,
+                            NULL);
   if (t_writer == TID_ERROR) return false;
+  t_ticker = thread_create ("buffercache_tick", PRI_DEFAULT,
+                            thread_get_cwd (), buffercache_cleaner_tick_thread,
+                            NULL);
+  if (t_ticker == TID_ERROR) return false;
 
   /* Create the buffercache readahead thread */
-  list_init (&readahead_list);
+  readahead_head = 0;
+  readahead_cnt = 0;
   lock_init (&readahead_lock);
   cond_init (&readahead_data);
   t_reader = thread_create ("buffercache_readahead", PRI_DEFAULT,
@@ -117,42 +217,24 @@ buffercache_init (const size_t size)
  */
 int
 buffercache_read (const block_sector_t sector, enum sector_type type,
-                  const int sector_ofs, const off_t size, void *buf,
-                  const block_sector_t next_sector)
+                  const int sector_ofs, const off_t size, void *buf)
 {
   struct cache_entry *entry = NULL;
 
-  /* Finds an entry and returns it with accessors incremented */
-  lock_acquire (&cache_lock);
-  entry = buffercache_find_entry (sector);
-  if (entry == NULL)
-    entry = buffercache_replace (sector, type);
-
   ASSERT (sector_ofs + size <= BLOCK_SECTOR_SIZE);
-  ASSERT (entry->state == READY);
-  ASSERT (entry->sector == sector);
-  ASSERT (entry->accessors > 0);
-
-  entry->accessed |= ACCESSED;
-  if (entry->type == METADATA)
-    entry->accessed |= META;
 
-  lock_release (&cache_lock);
+  /* Finds an entry and returns it with accessors incremented */
+  entry = buffercache_get_entry (sector, type, ACCESSED, NULL);
 
   if (entry != NULL)
   {
+    ASSERT (entry->sector == sector);
+
     /* Read from cache entry */
     memcpy (buf, entry->kaddr + sector_ofs, size);
 
     /* Adjust cache entry */
-    lock_acquire (&cache_lock);
-    entry->accessors--;
-    if (entry->accessors == 0)
-      cond_broadcast (&entry->c, &cache_lock);
-    lock_release (&cache_lock);
-
-    /* Trigger read-ahead */
-    buffercache_readahead_if_necessary (next_sector);
+    buffercache_release_entry (entry);
     return size;
   } else {
     /* Failsafe: bypass the cache */
@@ -162,48 +244,42 @@ buffercache_read (const block_sector_t sector, enum sector_type type,
 
 /**
  * Writes a sector from buf into sector. Does not do bounds checking on
- * sector_ofs and size.
+ * sector_ofs and size. OWNER is the sector of the inode the sector belongs
+ * to, so that buffercache_sync() can find it.
  *
  * Returns the number of bytes written, or -1 on failure.
  */
 int
 buffercache_write (const block_sector_t sector, enum sector_type type,
-                   const int sector_ofs, const off_t size, const void *buf,
-                   const block_sector_t next_sector)
+                   const block_sector_t owner, const int sector_ofs,
+                   const off_t size, const void *buf)
 {
   struct cache_entry *entry;
-
-  /* Finds an entry and returns it with accessors incremented */
-  lock_acquire (&cache_lock);
-  entry = buffercache_find_entry (sector);
-  if (entry == NULL)
-    entry = buffercache_replace (sector, type);
+  bool full;
 
   ASSERT (size <= BLOCK_SECTOR_SIZE);
-  ASSERT (entry->state == READY);
-  ASSERT (entry->sector == sector);
-  ASSERT (entry->accessors > 0);
-
-  entry->accessed |= ACCESSED | DIRTY;
-  if (entry->type == METADATA)
-    entry->accessed |= META;
 
-  lock_release (&cache_lock);
+  /* Finds an entry and returns it with accessors incremented. A write that
+     covers the whole sector does not need the old contents read in first. */
+  full = sector_ofs == 0 && size == BLOCK_SECTOR_SIZE;
+  entry = buffercache_get_entry (sector, type, ACCESSED | DIRTY,
+                                 full ? buf : NULL);
 
   if (entry != NULL)
   {
+    ASSERT (entry->sector == sector);
+
+    /* Our accessor reference keeps the entry from being written back until
+       the data is in, so the owner can be set before copying */
+    lock_acquire (&entry->l);
+    entry->owner = owner;
+    lock_release (&entry->l);
+
     /* Write to cache entry */
     memcpy (entry->kaddr + sector_ofs, buf, size);
 
     /* Adjust cache entry */
-    lock_acquire (&cache_lock);
-    entry->accessors--;
-    if (entry->accessors == 0)
-      cond_broadcast (&entry->c, &cache_lock);
-    lock_release (&cache_lock);
-
-    /* Trigger read-ahead and return */
-    buffercache_readahead_if_necessary (next_sector);
+    buffercache_release_entry (entry);
     return size;
   } else {
     /* Failsafe: bypass the cache */
@@ -212,32 +288,336 @@ buffercache_write (const block_sector_t sector, enum sector_type type,
 }
 
 /**
- * Flushes all dirty buffers in the cache to disk.
+ * Selects the replacement policy called NAME. Must be called before
+ * buffercache_init(). Panics if there is no such policy.
+ */
+void
+buffercache_set_policy (const char *name)
+{
+  policy = cache_policy_lookup (name);
+  if (policy == NULL)
+    PANIC ("unknown buffer cache policy `%s'", name);
+}
+
+/**
+ * Copies a snapshot of the cache counters into STATS.
+ */
+void
+buffercache_get_stats (struct cache_stats *stats_)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats_ = stats;
+  intr_set_level (old_level);
+}
+
+/**
+ * Prints buffer cache statistics.
+ */
+void
+buffercache_print_stats (void)
+{
+  struct cache_stats s;
+
+  buffercache_get_stats (&s);
+  printf ("Buffer cache: %llu hits, %llu misses, %llu metadata evictions, "
+          "%llu regular evictions\n", s.hits, s.misses, s.meta_evictions,
+          s.regular_evictions);
+  printf ("Buffer cache readahead: %llu issued, %llu used, %llu wasted\n",
+          s.readahead_issued, s.readahead_used, s.readahead_wasted);
+  printf ("Buffer cache writes: %llu flushes, %llu sectors written back, "
+          "%llu waits for %llu ticks\n", s.flushes, s.write_backs, s.waits,
+          s.wait_ticks);
+}
+
+/**
+ * Queues an asynchronous read of the given sector into the cache. The request
+ * is dropped if the sector is already cached or queued, or if the readahead
+ * queue is full.
+ */
+void
+buffercache_readahead (const block_sector_t sector)
+{
+  struct cache_bucket *b = buffercache_bucket (sector);
+  bool cached;
+  int i;
+
+  /* No read-ahead necessary */
+  if (sector == INODE_INVALID_BLOCK_SECTOR) return;
+
+  lock_acquire (&b->lock);
+  cached = buffercache_index_lookup (b, sector) != NULL;
+  lock_release (&b->lock);
+  if (cached) return;
+
+  /* Add to read-ahead queue unless it is already there */
+  lock_acquire (&readahead_lock);
+  for (i = 0; i < readahead_cnt; i++)
+    if (readahead_ring[(readahead_head + i) % BUFFERCACHE_READAHEAD_SIZE]
+        == sector)
+      break;
+  if (i == readahead_cnt && readahead_cnt < BUFFERCACHE_READAHEAD_SIZE)
+  {
+    readahead_ring[(readahead_head + readahead_cnt)
+                   % BUFFERCACHE_READAHEAD_SIZE] = sector;
+    readahead_cnt++;
+    cond_signal (&readahead_data, &readahead_lock);
+  }
+  lock_release (&readahead_lock);
+}
+
+/**
+ * Flushes all dirty buffers in the cache to disk. The dirty sectors are
+ * gathered and sorted first so that runs of adjacent sectors go out in a
+ * single multi-sector write, in ascending order across the disk. If AWAIT is
+ * set, also waits for writes already started by other threads.
  */
 void
 buffercache_flush (const bool await)
 {
   int i;
 
+  buffercache_stat (&stats.flushes, 1);
+  buffercache_write_back (INT64_MAX, INODE_INVALID_BLOCK_SECTOR);
+
+  if (await)
+    for (i = 0; i < cache_size; i++)
+      buffercache_await_write (&cache[i]);
+}
+
+/**
+ * Writes the dirty sectors last written on behalf of the inode at sector
+ * OWNER to disk, and waits for writes of them already in progress, leaving
+ * the rest of the cache alone.
+ */
+void
+buffercache_sync (const block_sector_t owner)
+{
+  struct cache_entry *e;
+  int i;
+
+  ASSERT (owner != INODE_INVALID_BLOCK_SECTOR);
+
+  buffercache_write_back (INT64_MAX, owner);
+
+  for (i = 0; i < cache_size; i++)
+  {
+    e = &cache[i];
+    lock_acquire (&e->l);
+    while (e->owner == owner
+           && (e->state == WRITE_REQUESTED || e->state == WRITING))
+      buffercache_wait (&e->written, e);
+    lock_release (&e->l);
+  }
+}
+
+/**
+ * Writes back the blocks that became dirty before tick DIRTIED_BEFORE,
+ * gathering and sorting them so that adjacent sectors share one request.
+ * Only blocks belonging to OWNER are written, unless it is
+ * INODE_INVALID_BLOCK_SECTOR.
+ *
+ * Dirty free map sectors are always written, and first: they mark in use the
+ * sectors that other dirty blocks may point to. The free map starts at the
+ * first sector of the disk, so sorting puts them ahead of everything else.
+ */
+static void
+buffercache_write_back (const int64_t dirtied_before,
+                        const block_sector_t owner)
+{
+  struct flush_item *items;
+  const void **bufs;
+  struct cache_entry *e;
+  int i, j, n, len, pass;
+  bool free_map, match;
+
+  items = malloc (cache_size * sizeof *items);
+  bufs = malloc (cache_size * sizeof *bufs);
+  if (items == NULL || bufs == NULL)
+  {
+    /* Fall back to writing entries one at a time, the free map first */
+    free (items);
+    free (bufs);
+    for (pass = 0; pass < 2; pass++)
+      for (i = 0; i < cache_size; i++)
+      {
+        e = &cache[i];
+        lock_acquire (&e->l);
+        free_map = e->owner == FREE_MAP_SECTOR_BEGIN;
+        match = free_map == (pass == 0)
+                && (free_map || owner == INODE_INVALID_BLOCK_SECTOR
+                    || e->owner == owner);
+        lock_release (&e->l);
+        if (match)
+          buffercache_flush_entry (e, false);
+      }
+    return;
+  }
+
+  /* Gather the dirty sectors */
+  n = 0;
   for (i = 0; i < cache_size; i++)
   {
-    lock_acquire (&cache_lock);
-    buffercache_flush_entry (&cache[i], await);
-    lock_release (&cache_lock);
+    e = &cache[i];
+    lock_acquire (&e->l);
+    free_map = e->owner == FREE_MAP_SECTOR_BEGIN;
+    if (e->accessed & DIRTY && (e->state == READY || e->state == CLOCK)
+        && (free_map
+            || (e->dirty_since < dirtied_before
+                && (owner == INODE_INVALID_BLOCK_SECTOR
+                    || e->owner == owner))))
+    {
+      items[n].entry = e;
+      items[n].sector = e->sector;
+      items[n].free_map = free_map;
+      n++;
+    }
+    lock_release (&e->l);
+  }
+  qsort (items, n, sizeof *items, buffercache_flush_item_cmp);
+
+  /* Write each run of adjacent sectors that are still dirty at once. A
+     run ends at an entry that is in use, rather than holding the rest of
+     the run in WRITING while its accessors finish */
+  for (i = 0; i < n; i += len)
+  {
+    len = 0;
+    while (i + len < n && items[i + len].sector == items[i].sector + len
+           && items[i + len].free_map == items[i].free_map
+           && buffercache_begin_write (items[i + len].entry,
+                                       items[i + len].sector,
+                                       &items[i + len].old_state, false))
+    {
+      bufs[len] = items[i + len].entry->kaddr;
+      len++;
+    }
+
+    /* In use, cleaned or replaced since it was gathered. An entry in use
+       is waited for and written on its own */
+    if (len == 0)
+    {
+      if (buffercache_begin_write (items[i].entry, items[i].sector,
+                                   &items[i].old_state, true))
+      {
+        block_write (fs_device, items[i].sector, items[i].entry->kaddr);
+        buffercache_end_write (items[i].entry, items[i].old_state);
+      }
+      len = 1;
+      continue;
+    }
+
+    block_write_multiple (fs_device, items[i].sector, len, bufs);
+    for (j = i; j < i + len; j++)
+      buffercache_end_write (items[j].entry, items[j].old_state);
+  }
+
+  free (items);
+  free (bufs);
+}
+
+/**
+ * Daemon thread that writes dirty blocks back in the background, so that
+ * replacement rarely has to write a victim itself. Each time it is woken it
+ * writes back every dirty block if too much of the cache is dirty, and
+ * otherwise only the blocks that have been dirty for too long. Every so often
+ * it also flushes the free map, so that released sectors become free on disk.
+ */
+static void
+buffercache_cleaner_thread (void *aux UNUSED)
+{
+  int64_t free_map_flushed = timer_ticks ();
+  bool pressure;
+
+  while (true)
+  {
+    lock_acquire (&cleaner_lock);
+    while (!clean_requested)
+      cond_wait (&cleaner_wake, &cleaner_lock);
+    clean_requested = false;
+    pressure = dirty_cnt * BUFFERCACHE_DIRTY_RATIO >= cache_size;
+    lock_release (&cleaner_lock);
+
+    if (pressure)
+      buffercache_write_back (INT64_MAX, INODE_INVALID_BLOCK_SECTOR);
+    else
+      buffercache_write_back (timer_ticks () - BUFFERCACHE_DIRTY_AGE,
+                              INODE_INVALID_BLOCK_SECTOR);
+
+    if (timer_elapsed (free_map_flushed) >= BUFFERCACHE_FREE_MAP_AGE)
+    {
+      free_map_flush ();
+      free_map_flushed = timer_ticks ();
+    }
   }
 }
 
 /**
- * Daemon thread that flushes all buffers to disk every 30 seconds.
+ * Daemon thread that wakes the cleaner every second to age dirty blocks.
  */
 static void
-buffercache_flush_thread (void *aux UNUSED)
+buffercache_cleaner_tick_thread (void *aux UNUSED)
 {
   while (true)
   {
-    timer_msleep (BUFFERCACHE_FLUSH_FREQUENCY);
-    buffercache_flush (false);
+    timer_msleep (BUFFERCACHE_CLEAN_FREQUENCY);
+    buffercache_request_clean ();
+  }
+}
+
+/**
+ * Wakes the cleaner thread.
+ */
+static void
+buffercache_request_clean (void)
+{
+  lock_acquire (&cleaner_lock);
+  clean_requested = true;
+  cond_signal (&cleaner_wake, &cleaner_lock);
+  lock_release (&cleaner_lock);
+}
+
+/**
+ * Adjusts the number of dirty entries by DELTA, waking the cleaner when the
+ * dirty ratio is crossed. Must not be called with an entry lock held.
+ */
+static void
+buffercache_count_dirty (const int delta)
+{
+  lock_acquire (&cleaner_lock);
+  dirty_cnt += delta;
+  if (delta > 0 && dirty_cnt * BUFFERCACHE_DIRTY_RATIO >= cache_size
+      && !clean_requested)
+  {
+    clean_requested = true;
+    cond_signal (&cleaner_wake, &cleaner_lock);
+  }
+  lock_release (&cleaner_lock);
+}
+
+/**
+ * Sets BITS in the accessed bits of an entry being handed to an accessor.
+ * Returns true if this made a clean entry dirty. The entry lock must be held.
+ *
+ * PREFETCHED is only ever set when the entry is loaded; the first real access
+ * afterwards clears it and counts the readahead as used.
+ */
+static bool
+buffercache_mark_accessed (struct cache_entry *entry, enum cache_accessed bits)
+{
+  bool dirtied = bits & DIRTY && !(entry->accessed & DIRTY);
+
+  ASSERT (lock_held_by_current_thread (&entry->l));
+
+  if (bits & ACCESSED && entry->accessed & PREFETCHED)
+  {
+    entry->accessed &= ~PREFETCHED;
+    buffercache_stat (&stats.readahead_used, 1);
   }
+  entry->accessed |= bits & ~PREFETCHED;
+  if (entry->type == METADATA)
+    entry->accessed |= META;
+  if (dirtied)
+    entry->dirty_since = timer_ticks ();
+  return dirtied;
 }
 
 /**
@@ -246,34 +626,25 @@ buffercache_flush_thread (void *aux UNUSED)
 static void
 buffercache_readahead_thread (void *aux UNUSED)
 {
-  struct list working_list;
-  struct readahead_entry *e;
-  void *buf[1];
-
-  list_init (&working_list);
+  struct cache_entry *e;
+  block_sector_t sector;
 
   while (true)
   {
-    /* Wait for data in readahead list */
+    /* Wait for data in readahead ring */
     lock_acquire (&readahead_lock);
-    while (list_empty (&readahead_list))
+    while (readahead_cnt == 0)
       cond_wait (&readahead_data, &readahead_lock);
 
-    /* Move entries to private list so other threads don't block */
-    while (!list_empty (&readahead_list))
-      list_push_front (&working_list, list_pop_back (&readahead_list));
-
+    sector = readahead_ring[readahead_head];
+    readahead_head = (readahead_head + 1) % BUFFERCACHE_READAHEAD_SIZE;
+    readahead_cnt--;
     lock_release (&readahead_lock);
 
-    /* Process readahead list */
-    while (!list_empty (&working_list))
-    {
-      e = list_entry (list_pop_front (&working_list), struct readahead_entry,
-                      elem);
-      buffercache_read (e->sector, REGULAR, 0, 1, buf,
-                        INODE_INVALID_BLOCK_SECTOR);
-      free (e);
-    }
+    /* Load the sector without marking it accessed, so that prefetched
+       blocks nobody reads are the first to be replaced */
+    e = buffercache_get_entry (sector, REGULAR, PREFETCHED, NULL);
+    buffercache_release_entry (e);
   }
 }
 
@@ -284,13 +655,18 @@ static void
 buffercache_allocate_block (struct cache_entry *entry, void *kaddr)
 {
   entry->kaddr = kaddr;
+  lock_init (&entry->l);
   entry->accessors = 0;
   entry->sector = INODE_INVALID_BLOCK_SECTOR;
   entry->next_sector = INODE_INVALID_BLOCK_SECTOR;
   entry->state = READY;
   entry->accessed = CLEAN;
   entry->type = REGULAR;
-  cond_init (&entry->c);
+  entry->dirty_since = 0;
+  entry->owner = INODE_INVALID_BLOCK_SECTOR;
+  cond_init (&entry->ready);
+  cond_init (&entry->written);
+  cond_init (&entry->idle);
 }
 
 /**
@@ -345,238 +721,444 @@ buffercache_read_direct (const block_sector_t sector, const int sector_ofs,
 }
 
 /**
- * Flushes the specified cache entry to disk (if necessary).
- *
- * Requires the cache_lock to be held.
+ * Flushes the specified cache entry to disk (if necessary). If AWAIT is set
+ * and another thread is already writing the entry, waits for it to finish.
  */
 static void
 buffercache_flush_entry (struct cache_entry *entry, const bool await)
 {
   enum cache_state old_state;
+  block_sector_t sector;
+
+  lock_acquire (&entry->l);
+  sector = entry->sector;
+  lock_release (&entry->l);
+
+  if (buffercache_begin_write (entry, sector, &old_state, true))
+  {
+    block_write (fs_device, sector, entry->kaddr);
+    buffercache_end_write (entry, old_state);
+  } else if (await) {
+    buffercache_await_write (entry);
+  }
+}
 
-  ASSERT (lock_held_by_current_thread (&cache_lock));
+/**
+ * Claims the entry for writing to disk if it still holds SECTOR, is dirty and
+ * is fully read/written. Waits for current accessors to finish if WAIT is
+ * set, and otherwise leaves an entry that has any alone. Returns true with the
+ * entry in the WRITING state and its previous state stored in *OLD_STATE;
+ * returns false if there is nothing to write.
+ */
+static bool
+buffercache_begin_write (struct cache_entry *entry,
+                         const block_sector_t sector,
+                         enum cache_state *old_state, const bool wait)
+{
+  lock_acquire (&entry->l);
 
   /* Only flush a dirty entry that is fully read/written */
-  if (entry->accessed & DIRTY && (entry->state == READY || entry->state == CLOCK))
+  if (!(entry->accessed & DIRTY) || entry->sector != sector
+      || (entry->state != READY && entry->state != CLOCK)
+      || (!wait && entry->accessors > 0))
   {
-    /* Save old state */
-    old_state = entry->state;
-
-    /* Wait for current accessors to finish */
-    entry->state = WRITE_REQUESTED;
-    while (entry->accessors > 0)
-      cond_wait (&entry->c, &cache_lock);
-
-    /* Write to disk */
-    entry->state = WRITING;     /* Tell threads block is writing */
-    lock_release (&cache_lock);
-
-    /* Perform I/O */
-    ASSERT (entry->sector != INODE_INVALID_BLOCK_SECTOR);
-    block_write (fs_device, entry->sector, entry->kaddr);
-
-    /* Fix up entry */
-    lock_acquire (&cache_lock);
-    entry->state = old_state;                   /* Restore state */
-    entry->accessed &= ~DIRTY;                  /* No longer dirty */
-    cond_broadcast (&entry->c, &cache_lock);    /* Tell threads writing is done */
-    cond_signal (&entries_ready, &cache_lock);
-  } else if (await && entry->accessed & DIRTY &&
-             (entry->state == WRITE_REQUESTED || entry->state == WRITING)) {
-    while (entry->state == WRITE_REQUESTED || entry->state == WRITING)
-      cond_wait (&entry->c, &cache_lock);
+    lock_release (&entry->l);
+    return false;
   }
+
+  /* Save old state */
+  *old_state = entry->state;
+
+  /* Wait for current accessors to finish */
+  entry->state = WRITE_REQUESTED;
+  while (entry->accessors > 0)
+    buffercache_wait (&entry->idle, entry);
+
+  /* Tell threads block is writing */
+  ASSERT (entry->sector != INODE_INVALID_BLOCK_SECTOR);
+  entry->state = WRITING;
+  lock_release (&entry->l);
+  return true;
 }
 
 /**
- * Invokes a read-ahead thread for the given block.
+ * Finishes a write started with buffercache_begin_write(), restoring the
+ * entry to OLD_STATE.
  */
 static void
-buffercache_readahead_if_necessary (const block_sector_t sector)
+buffercache_end_write (struct cache_entry *entry, enum cache_state old_state)
 {
-  struct readahead_entry *e;
+  lock_acquire (&entry->l);
+  ASSERT (entry->state == WRITING);
+  entry->state = old_state;                   /* Restore state */
+  entry->accessed &= ~DIRTY;                  /* No longer dirty */
+  cond_broadcast (&entry->written, &entry->l);
+  if (old_state == READY)
+    cond_broadcast (&entry->ready, &entry->l);
+  lock_release (&entry->l);
+
+  buffercache_stat (&stats.write_backs, 1);
+  buffercache_count_dirty (-1);
+
+  if (old_state == READY)
+    buffercache_signal_entries_ready ();
+}
 
-  /* No read-ahead necessary */
-  if (sector == INODE_INVALID_BLOCK_SECTOR) return;
+/**
+ * Waits until a write of the entry started by another thread finishes.
+ */
+static void
+buffercache_await_write (struct cache_entry *entry)
+{
+  lock_acquire (&entry->l);
+  while (entry->state == WRITE_REQUESTED || entry->state == WRITING)
+    buffercache_wait (&entry->written, entry);
+  lock_release (&entry->l);
+}
 
-  /* Add to read-ahead queue */
-  lock_acquire (&readahead_lock);
-  e = malloc (sizeof (struct readahead_entry));
-  if (e != NULL)
+/**
+ * Orders flush items by ascending sector.
+ */
+static int
+buffercache_flush_item_cmp (const void *a_, const void *b_)
+{
+  const struct flush_item *a = a_;
+  const struct flush_item *b = b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/**
+ * Returns the cache entry for the given sector, loading it into the cache if
+ * necessary. The entry is returned READY with its accessor count incremented
+ * and BITS set in its accessed bits; release it with
+ * buffercache_release_entry().
+ *
+ * If FILL is not NULL, the caller is about to overwrite the whole sector, and
+ * on a miss the entry is filled from FILL instead of being read from disk.
+ */
+static struct cache_entry *
+buffercache_get_entry (const block_sector_t sector, enum sector_type type,
+                       enum cache_accessed bits, const void *fill)
+{
+  struct cache_entry *e;
+
+  do
   {
-    e->sector = sector;
-    list_push_back (&readahead_list, &e->elem);
-    cond_broadcast (&readahead_data, &readahead_lock);
-  }
-  lock_release (&readahead_lock);
+    e = buffercache_find_entry (sector, bits);
+    if (e == NULL)
+      e = buffercache_replace (sector, type, bits, fill);
+  } while (e == NULL);
+
+  return e;
+}
+
+/**
+ * Drops an accessor reference obtained from buffercache_get_entry(), waking
+ * a flusher or evictor that is waiting for the entry to become idle.
+ */
+static void
+buffercache_release_entry (struct cache_entry *entry)
+{
+  lock_acquire (&entry->l);
+  ASSERT (entry->accessors > 0);
+  entry->accessors--;
+  if (entry->accessors == 0 && entry->state != READY)
+    cond_signal (&entry->idle, &entry->l);
+  lock_release (&entry->l);
 }
 
 /**
  * Returns the cache entry for the given sector if it is cached, else NULL.
+ * A returned entry has its accessor count incremented and BITS set.
+ *
+ * Only the sector's index bucket and the entry itself are locked, so hits on
+ * different sectors do not contend.
  */
 static struct cache_entry *
-buffercache_find_entry (const block_sector_t sector)
+buffercache_find_entry (const block_sector_t sector, enum cache_accessed bits)
 {
-  int i;
-
-  ASSERT (lock_held_by_current_thread (&cache_lock));
+  struct cache_bucket *b = buffercache_bucket (sector);
+  struct cache_entry *e;
+  bool dirtied;
 
-  for (i = 0; i < cache_size; i++)
+  lock_acquire (&b->lock);
+  while ((e = buffercache_index_lookup (b, sector)) != NULL)
   {
-    if (cache[i].sector == sector || cache[i].next_sector == sector)
-    {
-      /* If it's being read or written, wait */
-      while (cache[i].state != READY)
-        cond_wait (&cache[i].c, &cache_lock);
+    lock_acquire (&e->l);
+    lock_release (&b->lock);
 
-      /* Double-check in case it was replaced */
-      if (cache[i].sector != sector)
-      {
-        i = -1;                 /* Restart search */
-        continue;
-      } else {
-        cache[i].accessors++;   /* Prevent replacement */
-        return &cache[i];
-      }
+    /* If it's being read or written, wait */
+    while (e->state != READY)
+      buffercache_wait (&e->ready, e);
+
+    /* Double-check in case it was replaced */
+    if (e->sector == sector)
+    {
+      e->accessors++;           /* Prevent replacement */
+      dirtied = buffercache_mark_accessed (e, bits);
+      lock_release (&e->l);
+      if (dirtied)
+        buffercache_count_dirty (1);
+      if (!(bits & PREFETCHED))
+        buffercache_stat (&stats.hits, 1);
+      return e;
     }
+
+    lock_release (&e->l);
+    lock_acquire (&b->lock);
+  }
+  lock_release (&b->lock);
+
+  return NULL;
+}
+
+/**
+ * Returns the index bucket that the given sector hashes to.
+ */
+static inline struct cache_bucket *
+buffercache_bucket (const block_sector_t sector)
+{
+  return &buckets[hash_int (sector) & bucket_mask];
+}
+
+/**
+ * Looks up the entry in bucket B that holds the given sector, or that has
+ * claimed it and is about to load it. Returns NULL if there is none. The
+ * bucket lock must be held when calling this.
+ */
+static struct cache_entry *
+buffercache_index_lookup (struct cache_bucket *b, const block_sector_t sector)
+{
+  struct cache_entry *e;
+  struct list_elem *le;
+
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  for (le = list_begin (&b->entries); le != list_end (&b->entries);
+       le = list_next (le))
+  {
+    e = list_entry (le, struct cache_entry, sector_elem);
+    if (e->sector == sector)
+      return e;
+  }
+
+  for (le = list_begin (&b->claims); le != list_end (&b->claims);
+       le = list_next (le))
+  {
+    e = list_entry (le, struct cache_entry, claim_elem);
+    if (e->next_sector == sector)
+      return e;
   }
 
   return NULL;
 }
 
 /**
- * Use the clock algorithm to find an entry to replace (if necessary) and
+ * Use the replacement policy to find an entry to replace (if necessary) and
  * flush it to disk (also if necessary) and load in a new sector.
+ *
+ * Returns NULL if another thread claimed the sector first, in which case the
+ * caller should look it up again.
  */
 static struct cache_entry *
-buffercache_replace (const block_sector_t sector, enum sector_type type)
+buffercache_replace (const block_sector_t sector, enum sector_type type,
+                     enum cache_accessed bits, const void *fill)
 {
+  struct cache_bucket *b = buffercache_bucket (sector);
   struct cache_entry *e;
+  bool free_map;
 
-  ASSERT (lock_held_by_current_thread (&cache_lock));
+  e = buffercache_victim ();                 /* Marks state as CLOCK */
 
-  e = buffercache_clock_algorithm ();        /* Marks state as CLOCK */
-  if (e == NULL) return NULL;
+  /* Claim the cache entry, unless someone beat us to the sector */
+  lock_acquire (&b->lock);
+  if (buffercache_index_lookup (b, sector) != NULL)
+  {
+    lock_release (&b->lock);
+    buffercache_unclaim (e);
+    return NULL;
+  }
+  lock_acquire (&e->l);
+  e->next_sector = sector;
+  lock_release (&e->l);
+  list_push_back (&b->claims, &e->claim_elem);
+  lock_release (&b->lock);
+
+  /* The free map goes to disk before anything that may point into it */
+  lock_acquire (&e->l);
+  free_map = e->accessed & DIRTY && e->owner != FREE_MAP_SECTOR_BEGIN;
+  lock_release (&e->l);
+  if (free_map)
+    buffercache_sync (FREE_MAP_SECTOR_BEGIN);
 
-  e->next_sector = sector;                   /* Claim the cache entry */
   buffercache_flush_entry (e, true);         /* Write current entry */
-  buffercache_load_entry (e, sector, type);  /* Read new entry into buffer */
-  e->accessors++;                            /* Prevent replacement */
+  buffercache_load_entry (e, sector, type, bits, fill); /* Read new entry */
 
   return e;
 }
 
 /**
- * Loads a disk sector into a buffer. Expects the cache lock to be acquired
- * when called, releases it during I/O, and re-acquires it before returning.
+ * Loads a disk sector into a buffer claimed by the replacement policy. Returns
+ * with the entry READY and its accessor count incremented for the caller.
+ *
+ * If FILL is not NULL the sector is about to be overwritten in full, so the
+ * buffer is copied from FILL and the disk read is skipped.
  */
 static void
 buffercache_load_entry (struct cache_entry *entry, const block_sector_t
-                        sector, enum sector_type type)
+                        sector, enum sector_type type,
+                        enum cache_accessed bits, const void *fill)
 {
-  ASSERT (lock_held_by_current_thread (&cache_lock));
-  ASSERT (entry->state != READY);
+  struct cache_bucket *b = buffercache_bucket (sector);
+  block_sector_t old_sector;
+  enum sector_type old_type;
+  bool dirtied, unused;
 
   /* Wait for others to finish */
+  lock_acquire (&entry->l);
+  ASSERT (entry->state == CLOCK);
+  ASSERT (entry->next_sector == sector);
   while (entry->accessors > 0)
-    cond_wait (&entry->c, &cache_lock);
+    buffercache_wait (&entry->idle, entry);
+  old_sector = entry->sector;
+  old_type = entry->type;
+  unused = entry->accessed & PREFETCHED;
+  lock_release (&entry->l);
+
+  /* Account for the sector being replaced */
+  if (old_sector != INODE_INVALID_BLOCK_SECTOR)
+  {
+    buffercache_stat (old_type == METADATA ? &stats.meta_evictions
+                                           : &stats.regular_evictions, 1);
+    if (unused)
+      buffercache_stat (&stats.readahead_wasted, 1);
+  }
+  buffercache_stat (bits & PREFETCHED ? &stats.readahead_issued
+                                      : &stats.misses, 1);
+
+  /* Drop the old sector from the index */
+  if (old_sector != INODE_INVALID_BLOCK_SECTOR)
+  {
+    struct cache_bucket *old = buffercache_bucket (old_sector);
+    lock_acquire (&old->lock);
+    list_remove (&entry->sector_elem);
+    lock_release (&old->lock);
+  }
 
-  ASSERT (entry->accessors == 0);
+  /* Let the replacement policy know about the new sector */
+  lock_acquire (&policy_lock);
+  policy->loaded (entry, old_sector, sector);
+  lock_release (&policy_lock);
 
-  /* Fix cache entry */
+  /* Turn the claim into an index entry and fix cache entry */
+  lock_acquire (&b->lock);
+  lock_acquire (&entry->l);
+  list_remove (&entry->claim_elem);
+  list_push_back (&b->entries, &entry->sector_elem);
   entry->sector = sector;
   entry->next_sector = INODE_INVALID_BLOCK_SECTOR;
   entry->state = READING;
-  entry->accessed = CLEAN;
+  entry->accessed = bits & PREFETCHED;
+  entry->owner = INODE_INVALID_BLOCK_SECTOR;
   entry->type = type;
-  lock_release (&cache_lock);
+  lock_release (&entry->l);
+  lock_release (&b->lock);
 
-  /* Perform I/O */
-  ASSERT (entry->sector != INODE_INVALID_BLOCK_SECTOR);
-  block_read (fs_device, entry->sector, entry->kaddr);
+  /* Perform I/O, unless the caller is replacing the contents anyway */
+  if (fill != NULL)
+    memcpy (entry->kaddr, fill, BLOCK_SECTOR_SIZE);
+  else
+    block_read (fs_device, entry->sector, entry->kaddr);
 
-  /* Re-acquire cache lock */
-  lock_acquire (&cache_lock);
+  /* Ready to be used, with the caller as the first accessor */
+  lock_acquire (&entry->l);
+  entry->state = READY;
+  entry->accessors++;
+  dirtied = buffercache_mark_accessed (entry, bits);
+  cond_broadcast (&entry->ready, &entry->l);
+  lock_release (&entry->l);
+
+  if (dirtied)
+    buffercache_count_dirty (1);
+  buffercache_signal_entries_ready ();
+}
 
-  /* Ready to be used */
+/**
+ * Hands an entry claimed by the replacement policy back unchanged.
+ */
+static void
+buffercache_unclaim (struct cache_entry *entry)
+{
+  lock_acquire (&entry->l);
+  ASSERT (entry->state == CLOCK);
   entry->state = READY;
-  cond_broadcast (&entry->c, &cache_lock);
-  cond_signal (&entries_ready, &cache_lock);
+  cond_broadcast (&entry->ready, &entry->l);
+  lock_release (&entry->l);
+
+  buffercache_signal_entries_ready ();
 }
 
 /**
- * Runs the clock algorithm to find the next entry to replace. The cache
- * lock must be held when calling this.
- *
- * The algorithm proceeds as follows: for each advancement of the clock,
- * if the entry is locked it is ignored. If the accessed bit is set it is
- * reset. If the accessed bit is not set then this entry is returned. If
- * we wrap around then the clock hand is returned.
- *
- * An additional "chance" (i.e. this becomes a "3rd-chance" algorithm) is given
- * for metadata blocks, since those are more valuable to keep in the cache.
+ * Wakes a thread waiting in buffercache_victim() for an entry to become
+ * replaceable. Must not be called with an entry lock held.
+ */
+static void
+buffercache_signal_entries_ready (void)
+{
+  lock_acquire (&policy_lock);
+  cond_signal (&entries_ready, &policy_lock);
+  lock_release (&policy_lock);
+}
+
+/**
+ * Asks the replacement policy for an entry to replace, waiting until one
+ * becomes available if every entry is busy.
  *
- * Returns a locked entry that is ready to be flushed to disk and replaced.
+ * Returns an entry in the CLOCK state that is ready to be flushed to disk and
+ * replaced.
  */
 static struct cache_entry *
-buffercache_clock_algorithm (void)
+buffercache_victim (void)
 {
-  int clock_start, count;
   struct cache_entry *e;
 
-  ASSERT (lock_held_by_current_thread (&cache_lock));
+  lock_acquire (&policy_lock);
+  while ((e = policy->victim ()) == NULL)
+    cond_wait (&entries_ready, &policy_lock);
+  lock_release (&policy_lock);
 
-  /* Set clock_start to the first READY entry, if needed  */
-  clock_start = buffercache_clock_next ();
-  count = 0;
-  while (cache[clock_start].state != READY)
-  {
-    clock_start = buffercache_clock_next ();
+  /* The policy only hands out a dirty victim if there were no clean ones,
+     so the cleaner is falling behind */
+  if (e->accessed & DIRTY)
+    buffercache_request_clean ();
 
-    /* If we have gone a whole time around, we need to
-       wait until something becomes available */
-    count++;
-    if (count == cache_size)
-    {
-      cond_wait (&entries_ready, &cache_lock);
-      count = 0;
-    }
-  }
+  return e;
+}
 
-  /* Run the clock algorithm */
-  e = &cache[clock_start];
-  do
-  {
-    /* Only consider if no I/O is happening to this block */
-    if (e->state == READY)
-    {
-      if (e->accessed & ACCESSED) {
-        /* Access bit is set, unset it and continue */
-        e->accessed &= ~ACCESSED;
-      } else if (e->accessed & META) {
-        /* Double-chance for metadata blocks */
-        e->accessed &= ~META;
-      } else {
-        /* Access and meta bits not set, return this entry */
-        break;
-      }
-    }
-    /* Look at the next entry */
-    e = &cache[buffercache_clock_next ()];
-  } while (clock_hand != clock_start);
+/**
+ * Waits on one of ENTRY's conditions, whose lock must be held, recording the
+ * time spent waiting.
+ */
+static void
+buffercache_wait (struct condition *cond, struct cache_entry *entry)
+{
+  int64_t start = timer_ticks ();
 
-  /* Claim this entry for ourselves */
-  ASSERT (e->state == READY);
-  e->state = CLOCK;
-  return e;
+  cond_wait (cond, &entry->l);
+  buffercache_stat (&stats.waits, 1);
+  buffercache_stat (&stats.wait_ticks, timer_elapsed (start));
 }
 
 /**
- * Helper function for the clock algorithm which treats the entries as a
- * circularly linked list.
+ * Adds N to one of the cache counters. Counters are bumped from many threads
+ * without a common lock, and a 64-bit add is not atomic, so interrupts are
+ * turned off around it instead.
  */
-static inline int
-buffercache_clock_next (void)
+static inline void
+buffercache_stat (uint64_t *counter, const int64_t n)
 {
-  return (clock_hand = (clock_hand + 1) % cache_size);
+  enum intr_level old_level = intr_disable ();
+  *counter += n;
+  intr_set_level (old_level);
 }
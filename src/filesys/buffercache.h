@@ -1,6 +1,8 @@
 #ifndef FILESYS_BUFFERCACHE_H
 #define FILESYS_BUFFERCACHE_H
 
+#include <cache-stats.h>
+#include <list.h>
 #include "devices/block.h"
 #include "filesys/off_t.h"
 #include "threads/synch.h"
@@ -39,30 +41,47 @@ enum cache_accessed
   ACCESSED = 0x01,              /* Accessed bit */
   DIRTY = 0x02,                 /* Dirty bit */
   META = 0x04,                  /* Metadata bit */
+  PREFETCHED = 0x08,            /* Read ahead and not accessed since */
 };
 
 /**
- * A single entry in the buffer cache
+ * A single entry in the buffer cache. The fields below kaddr are protected
+ * by the entry lock; sector and next_sector are additionally only changed
+ * while holding the lock of the index bucket the entry is moving in or out
+ * of.
  */
 struct cache_entry
 {
   void *kaddr;                  /* Address of cache block */
+  struct lock l;                /* Protects the entry */
   int accessors;                /* Number of threads accessing buffer */
   block_sector_t sector;        /* Sector of block */
   block_sector_t next_sector;   /* Sector block will contain next */
   enum cache_state state;       /* Current state of block */
   enum cache_accessed accessed;	/* Accessed bits for block */
   enum sector_type type;        /* The type of sector */
-  struct condition c;           /* To notify waiting threads */
+  int64_t dirty_since;          /* Timer ticks when block became dirty */
+  block_sector_t owner;         /* Inode sector of the last writer */
+  struct condition ready;       /* Signaled when state becomes READY */
+  struct condition written;     /* Signaled when a WRITING finishes */
+  struct condition idle;        /* Signaled when the last accessor leaves */
+  struct list_elem sector_elem; /* Index element keyed by sector */
+  struct list_elem claim_elem;  /* Index element keyed by next_sector */
+  struct list_elem policy_elem; /* Replacement policy list element */
+  int queue;                    /* Replacement policy queue */
 };
 
 bool buffercache_init (const size_t size);
 int buffercache_read (const block_sector_t sector, enum sector_type type,
-                      const int sector_ofs, const off_t size, void *buf,
-                      const block_sector_t next_sector);
+                      const int sector_ofs, const off_t size, void *buf);
 int buffercache_write (const block_sector_t sector, enum sector_type type,
-                       const int sector_ofs, const off_t size, const void *buf,
-                       const block_sector_t next_sector);
+                       const block_sector_t owner, const int sector_ofs,
+                       const off_t size, const void *buf);
+void buffercache_readahead (const block_sector_t sector);
 void buffercache_flush (const bool await);
+void buffercache_sync (const block_sector_t owner);
+void buffercache_set_policy (const char *name);
+void buffercache_get_stats (struct cache_stats *stats);
+void buffercache_print_stats (void);
 
 #endif
@@ -0,0 +1,405 @@
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+
+#include "filesys/cache-policy.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+
+/* Queues an entry can be on under the 2Q policy */
+#define TWOQ_A1IN 0             /* Referenced once, FIFO */
+#define TWOQ_AM 1               /* Referenced again after leaving A1in */
+
+/**
+ * A sector recently evicted from A1in, remembered so that a re-reference
+ * can be told apart from a first reference.
+ */
+struct twoq_ghost
+{
+  block_sector_t sector;        /* Evicted sector, or invalid if unused */
+  struct hash_elem elem;        /* Element in ghost_index */
+};
+
+static struct cache_entry *cache;      /* Entries managed by the policy */
+static int cache_size;                 /* Number of entries */
+
+/* Clock state */
+static int clock_hand;                 /* For clock algorithm */
+
+/* 2Q state */
+static struct list a1in;               /* Entries referenced once */
+static struct list am;                 /* Entries referenced more than once */
+static int a1in_cnt;                   /* Entries on a1in */
+static int a1in_max;                   /* Target size of a1in (Kin) */
+static struct twoq_ghost *ghosts;      /* Ring of sectors evicted from a1in */
+static int ghost_head;                 /* Oldest slot in ghosts */
+static int ghost_cnt;                  /* Used slots in ghosts */
+static int ghost_max;                  /* Size of ghosts (Kout) */
+static struct hash ghost_index;        /* Sectors in ghosts */
+
+static bool clock_init (struct cache_entry *cache, int size);
+static struct cache_entry *clock_victim (void);
+static void clock_loaded (struct cache_entry *e, block_sector_t old_sector,
+                          block_sector_t sector);
+static inline int clock_next (void);
+static bool twoq_init (struct cache_entry *cache, int size);
+static struct cache_entry *twoq_victim (void);
+static struct cache_entry *twoq_victim_a1in (bool allow_dirty);
+static struct cache_entry *twoq_victim_am (bool allow_dirty);
+static void twoq_loaded (struct cache_entry *e, block_sector_t old_sector,
+                         block_sector_t sector);
+static void twoq_ghost_add (block_sector_t sector);
+static bool twoq_ghost_take (block_sector_t sector);
+static unsigned twoq_ghost_hash (const struct hash_elem *e, void *aux);
+static bool twoq_ghost_less (const struct hash_elem *a,
+                             const struct hash_elem *b, void *aux);
+static bool cache_policy_claim (struct cache_entry *e, bool allow_dirty);
+static bool cache_policy_second_chance (struct cache_entry *e,
+                                        bool allow_dirty);
+
+/**
+ * Clock with an extra chance for metadata blocks.
+ */
+static const struct cache_policy clock_policy =
+{
+  "clock",
+  clock_init,
+  clock_victim,
+  clock_loaded
+};
+
+/**
+ * 2Q (Johnson and Shasha). Blocks start on a small FIFO, A1in, and are only
+ * admitted to the main queue, Am, if they are referenced again soon after
+ * being evicted from A1in. A single sequential scan therefore only cycles
+ * through A1in and cannot push the hot metadata set out of Am. Am is run as
+ * a clock so that hits do not need to reorder it.
+ */
+static const struct cache_policy twoq_policy =
+{
+  "2q",
+  twoq_init,
+  twoq_victim,
+  twoq_loaded
+};
+
+static const struct cache_policy *policies[] =
+{
+  &clock_policy,
+  &twoq_policy
+};
+
+/**
+ * Returns the policy called NAME, or NULL if there is none.
+ */
+const struct cache_policy *
+cache_policy_lookup (const char *name)
+{
+  size_t i;
+
+  if (name == NULL) return NULL;
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (policies[i]->name, name))
+      return policies[i];
+  return NULL;
+}
+
+/**
+ * Initializes the clock policy.
+ */
+static bool
+clock_init (struct cache_entry *cache_, int size)
+{
+  cache = cache_;
+  cache_size = size;
+
+  /* Initialize the clock hand so first access will be slot 0 */
+  clock_hand = cache_size - 1;
+  return true;
+}
+
+/**
+ * Runs the clock algorithm to find the next entry to replace.
+ *
+ * The algorithm proceeds as follows: for each advancement of the clock,
+ * if the entry is busy it is ignored. If the accessed bit is set it is
+ * reset. If the accessed bit is not set then this entry is returned.
+ *
+ * An additional "chance" (i.e. this becomes a "3rd-chance" algorithm) is given
+ * for metadata blocks, since those are more valuable to keep in the cache.
+ *
+ * Dirty entries are passed over while there is a clean one to take, so that
+ * a miss does not have to wait for a write.
+ */
+static struct cache_entry *
+clock_victim (void)
+{
+  int count;
+  struct cache_entry *e;
+
+  /* Three sweeps clear both the accessed and metadata chances; only after
+     that many without finding a clean entry is a dirty one taken */
+  for (count = 0; count < 6 * cache_size; count++)
+  {
+    e = &cache[clock_next ()];
+    if (cache_policy_second_chance (e, count >= 3 * cache_size))
+      return e;
+  }
+  return NULL;
+}
+
+/**
+ * The clock keeps no per-sector state.
+ */
+static void
+clock_loaded (struct cache_entry *e UNUSED, block_sector_t old_sector UNUSED,
+              block_sector_t sector UNUSED)
+{
+}
+
+/**
+ * Helper function for the clock algorithm which treats the entries as a
+ * circularly linked list.
+ */
+static inline int
+clock_next (void)
+{
+  return (clock_hand = (clock_hand + 1) % cache_size);
+}
+
+/**
+ * Initializes the 2Q policy. A1in is kept to a quarter of the cache and
+ * sectors evicted from it are remembered for half the cache size, as
+ * recommended for 2Q. All entries start out empty on A1in.
+ */
+static bool
+twoq_init (struct cache_entry *cache_, int size)
+{
+  int i;
+
+  cache = cache_;
+  cache_size = size;
+
+  list_init (&a1in);
+  list_init (&am);
+  for (i = 0; i < cache_size; i++)
+  {
+    cache[i].queue = TWOQ_A1IN;
+    list_push_back (&a1in, &cache[i].policy_elem);
+  }
+  a1in_cnt = cache_size;
+  a1in_max = cache_size / 4 > 0 ? cache_size / 4 : 1;
+
+  ghost_max = cache_size / 2 > 0 ? cache_size / 2 : 1;
+  ghost_head = 0;
+  ghost_cnt = 0;
+  ghosts = malloc (ghost_max * sizeof *ghosts);
+  if (ghosts == NULL)
+    return false;
+  return hash_init (&ghost_index, twoq_ghost_hash, twoq_ghost_less, NULL);
+}
+
+/**
+ * Picks a victim from A1in while it is over its target size, otherwise from
+ * Am, falling back to the other queue if every entry on the first is busy.
+ */
+static struct cache_entry *
+twoq_victim (void)
+{
+  struct cache_entry *e = NULL;
+  bool allow_dirty;
+
+  /* Prefer clean victims, only taking a dirty one if nothing else is free */
+  for (allow_dirty = false; ; allow_dirty = true)
+  {
+    if (a1in_cnt > a1in_max || list_empty (&am))
+      e = twoq_victim_a1in (allow_dirty);
+    if (e == NULL)
+      e = twoq_victim_am (allow_dirty);
+    if (e == NULL)
+      e = twoq_victim_a1in (allow_dirty);
+    if (e != NULL || allow_dirty)
+      return e;
+  }
+}
+
+/**
+ * Claims the oldest idle entry on A1in. References while on A1in are
+ * ignored: they are usually correlated accesses to a block being streamed.
+ */
+static struct cache_entry *
+twoq_victim_a1in (bool allow_dirty)
+{
+  struct list_elem *le;
+  struct cache_entry *e;
+
+  for (le = list_begin (&a1in); le != list_end (&a1in); le = list_next (le))
+  {
+    e = list_entry (le, struct cache_entry, policy_elem);
+    if (cache_policy_claim (e, allow_dirty))
+      return e;
+  }
+  return NULL;
+}
+
+/**
+ * Runs the clock over Am, rotating every entry it looks at to the back.
+ */
+static struct cache_entry *
+twoq_victim_am (bool allow_dirty)
+{
+  struct cache_entry *e;
+  int count, len;
+
+  len = list_size (&am);
+  for (count = 0; count < 3 * len; count++)
+  {
+    e = list_entry (list_pop_front (&am), struct cache_entry, policy_elem);
+    list_push_back (&am, &e->policy_elem);
+    if (cache_policy_second_chance (e, allow_dirty))
+      return e;
+  }
+  return NULL;
+}
+
+/**
+ * Files entry E under the queue for its new SECTOR: Am if SECTOR was evicted
+ * from A1in recently, A1in otherwise. If E is leaving A1in, its old sector
+ * is remembered.
+ */
+static void
+twoq_loaded (struct cache_entry *e, block_sector_t old_sector,
+             block_sector_t sector)
+{
+  list_remove (&e->policy_elem);
+  if (e->queue == TWOQ_A1IN)
+  {
+    a1in_cnt--;
+    if (old_sector != INODE_INVALID_BLOCK_SECTOR)
+      twoq_ghost_add (old_sector);
+  }
+
+  if (twoq_ghost_take (sector))
+  {
+    e->queue = TWOQ_AM;
+    list_push_back (&am, &e->policy_elem);
+  } else {
+    e->queue = TWOQ_A1IN;
+    list_push_back (&a1in, &e->policy_elem);
+    a1in_cnt++;
+  }
+}
+
+/**
+ * Remembers SECTOR as evicted from A1in, forgetting the oldest remembered
+ * sector if the ring is full.
+ */
+static void
+twoq_ghost_add (block_sector_t sector)
+{
+  struct twoq_ghost key, *g;
+
+  key.sector = sector;
+  if (hash_find (&ghost_index, &key.elem) != NULL)
+    return;
+
+  if (ghost_cnt == ghost_max)
+  {
+    g = &ghosts[ghost_head];
+    if (g->sector != INODE_INVALID_BLOCK_SECTOR)
+      hash_delete (&ghost_index, &g->elem);
+    ghost_head = (ghost_head + 1) % ghost_max;
+    ghost_cnt--;
+  }
+
+  g = &ghosts[(ghost_head + ghost_cnt) % ghost_max];
+  g->sector = sector;
+  hash_insert (&ghost_index, &g->elem);
+  ghost_cnt++;
+}
+
+/**
+ * Forgets SECTOR if it was remembered as evicted from A1in. Returns true if
+ * it was.
+ */
+static bool
+twoq_ghost_take (block_sector_t sector)
+{
+  struct twoq_ghost key, *g;
+  struct hash_elem *he;
+
+  key.sector = sector;
+  he = hash_delete (&ghost_index, &key.elem);
+  if (he == NULL)
+    return false;
+
+  /* Leave the slot in the ring; it is skipped when it ages out */
+  g = hash_entry (he, struct twoq_ghost, elem);
+  g->sector = INODE_INVALID_BLOCK_SECTOR;
+  return true;
+}
+
+static unsigned
+twoq_ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct twoq_ghost, elem)->sector);
+}
+
+static bool
+twoq_ghost_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return hash_entry (a, struct twoq_ghost, elem)->sector
+         < hash_entry (b, struct twoq_ghost, elem)->sector;
+}
+
+/**
+ * Claims E for replacement if no I/O is happening to it and, unless
+ * ALLOW_DIRTY is set, it is clean.
+ */
+static bool
+cache_policy_claim (struct cache_entry *e, bool allow_dirty)
+{
+  bool claimed = false;
+
+  lock_acquire (&e->l);
+  if (e->state == READY && (allow_dirty || !(e->accessed & DIRTY)))
+  {
+    e->state = CLOCK;
+    claimed = true;
+  }
+  lock_release (&e->l);
+  return claimed;
+}
+
+/**
+ * Claims E for replacement if no I/O is happening to it and it has used up
+ * its chances. Otherwise takes away one chance: the accessed bit first, then
+ * the metadata bit. A dirty entry that has used up its chances is only
+ * claimed if ALLOW_DIRTY is set.
+ */
+static bool
+cache_policy_second_chance (struct cache_entry *e, bool allow_dirty)
+{
+  bool claimed = false;
+
+  /* Only consider if no I/O is happening to this block */
+  lock_acquire (&e->l);
+  if (e->state == READY)
+  {
+    if (e->accessed & ACCESSED) {
+      /* Access bit is set, unset it and continue */
+      e->accessed &= ~ACCESSED;
+    } else if (e->accessed & META) {
+      /* Double-chance for metadata blocks */
+      e->accessed &= ~META;
+    } else if (allow_dirty || !(e->accessed & DIRTY)) {
+      /* Access and meta bits not set, claim this entry */
+      e->state = CLOCK;
+      claimed = true;
+    }
+  }
+  lock_release (&e->l);
+  return claimed;
+}
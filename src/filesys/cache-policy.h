@@ -0,0 +1,35 @@
+#ifndef FILESYS_CACHE_POLICY_H
+#define FILESYS_CACHE_POLICY_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/buffercache.h"
+
+/**
+ * A replacement policy for the buffer cache.
+ *
+ * All hooks are called with the buffer cache's policy lock held and no entry
+ * lock held. Cache hits never call into the policy; they only set the entry's
+ * accessed bits, which the policy may inspect when choosing a victim.
+ */
+struct cache_policy
+{
+  const char *name;             /* Name selected on the command line */
+
+  /* Sets up the policy for the SIZE entries of CACHE, all of which are
+     empty. Returns false on failure. */
+  bool (*init) (struct cache_entry *cache, int size);
+
+  /* Picks an entry to replace and moves it from READY to CLOCK under its
+     lock. Returns NULL if no entry can be replaced right now. */
+  struct cache_entry *(*victim) (void);
+
+  /* Called once entry E, previously holding OLD_SECTOR, has been given
+     SECTOR and is about to be read in. */
+  void (*loaded) (struct cache_entry *e, block_sector_t old_sector,
+                  block_sector_t sector);
+};
+
+const struct cache_policy *cache_policy_lookup (const char *name);
+
+#endif
@@ -0,0 +1,204 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A cached directory entry: NAME in the directory at sector
+   PARENT is the inode at SECTOR, or does not exist if SECTOR is
+   INODE_INVALID_BLOCK_SECTOR. */
+struct dentry
+{
+  struct hash_elem hash_elem;   /* Element in DENTRIES */
+  struct list_elem lru_elem;    /* Element in LRU */
+  block_sector_t parent;        /* Sector of the directory */
+  char name[NAME_MAX + 1];      /* Name in the directory */
+  block_sector_t sector;        /* Sector of the inode it names */
+};
+
+/* Cached entries by parent and name, and from least to most
+   recently used. LOCK protects both, and GENERATION, which counts
+   invalidations so that a lookup that raced with a change to the
+   directory is not cached. */
+static struct hash dentries;
+static struct list lru;
+static size_t dentry_cnt;
+static unsigned generation;
+static struct lock lock;
+
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null pointer.
+   The lock must be held. */
+static struct dentry *
+dentry_find (block_sector_t parent, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops entry D from the cache. The lock must be held. */
+static void
+dentry_drop (struct dentry *d)
+{
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  dentry_cnt--;
+  free (d);
+}
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentries, dentry_hash, dentry_less, NULL);
+  list_init (&lru);
+  lock_init (&lock);
+}
+
+/* Returns the current generation, to be passed to dcache_insert()
+   for a name looked up in its directory after this call. */
+unsigned
+dcache_generation (void)
+{
+  unsigned g;
+
+  lock_acquire (&lock);
+  g = generation;
+  lock_release (&lock);
+  return g;
+}
+
+/* Looks up NAME in the directory at sector PARENT. If it is
+   cached, returns true and sets *SECTORP to the sector of its
+   inode, or to INODE_INVALID_BLOCK_SECTOR if it is known not to
+   exist. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&lock);
+  d = dentry_find (parent, name);
+  if (d != NULL)
+  {
+    *sectorp = d->sector;
+    list_remove (&d->lru_elem);
+    list_push_back (&lru, &d->lru_elem);
+  }
+  lock_release (&lock);
+  return d != NULL;
+}
+
+/* Caches that NAME in the directory at sector PARENT is the inode
+   at SECTOR, or does not exist if SECTOR is
+   INODE_INVALID_BLOCK_SECTOR. Nothing is cached if anything was
+   invalidated since GENERATION was returned by
+   dcache_generation(). The least recently used entry is dropped
+   to make room. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector, unsigned generation_)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&lock);
+  if (generation_ != generation)
+    goto done;
+
+  d = dentry_find (parent, name);
+  if (d == NULL && dentry_cnt >= DCACHE_SIZE)
+  {
+    d = list_entry (list_front (&lru), struct dentry, lru_elem);
+    hash_delete (&dentries, &d->hash_elem);
+    list_remove (&d->lru_elem);
+    dentry_cnt--;
+  }
+  else if (d == NULL)
+    d = malloc (sizeof *d);
+  else
+  {
+    d->sector = sector;
+    goto done;
+  }
+
+  if (d == NULL)
+    goto done;
+  d->parent = parent;
+  strlcpy (d->name, name, sizeof d->name);
+  d->sector = sector;
+  hash_insert (&dentries, &d->hash_elem);
+  list_push_back (&lru, &d->lru_elem);
+  dentry_cnt++;
+
+ done:
+  lock_release (&lock);
+}
+
+/* Forgets what is cached about NAME in the directory at sector
+   PARENT. Called after the directory changes. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&lock);
+  generation++;
+  d = dentry_find (parent, name);
+  if (d != NULL)
+    dentry_drop (d);
+  lock_release (&lock);
+}
+
+/* Forgets all the names cached in the directory at sector PARENT,
+   which is being removed, so that none are found if the sector is
+   reused. */
+void
+dcache_invalidate_dir (block_sector_t parent)
+{
+  struct list_elem *e, *next;
+  struct dentry *d;
+
+  lock_acquire (&lock);
+  generation++;
+  for (e = list_begin (&lru); e != list_end (&lru); e = next)
+  {
+    next = list_next (e);
+    d = list_entry (e, struct dentry, lru_elem);
+    if (d->parent == parent)
+      dentry_drop (d);
+  }
+  lock_release (&lock);
+}
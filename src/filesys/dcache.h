@@ -0,0 +1,19 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of names the dentry cache holds */
+#define DCACHE_SIZE 256
+
+void dcache_init (void);
+unsigned dcache_generation (void);
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sectorp);
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector, unsigned generation);
+void dcache_invalidate (block_sector_t parent, const char *name);
+void dcache_invalidate_dir (block_sector_t parent);
+
+#endif /* filesys/dcache.h */
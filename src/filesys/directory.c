@@ -1,8 +1,11 @@
  #include "filesys/directory.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/buffercache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -25,9 +28,65 @@ struct dir_entry
   bool in_use;                        /* In use or free? */
 };
 
+/* Directories that grow to this many entry slots are given a hash
+   index, so that looking up, adding and removing a name no longer
+   reads every entry. The entries stay where they are, and entry
+   slot DIR_INDEX_SLOT, which dir_create() reserves and dir_add()
+   never uses, holds the sector of the index's inode under an empty
+   name. A directory's entries and index are read with its inode's
+   directory lock held for reading, and changed with it held for
+   writing. */
+#define DIR_INDEX_MIN 64
+#define DIR_INDEX_SLOT 2
+
+/* Header of a directory's hash index. The hash slots follow at
+   DIR_INDEX_OFS. A name is found by probing the slots one after
+   another from the one its hash selects. */
+struct dir_index_header
+{
+  uint32_t magic;               /* DIR_INDEX_MAGIC once complete */
+  uint32_t size;                /* Number of hash slots, a power of 2 */
+  uint32_t used;                /* Slots holding an entry */
+  uint32_t removed;             /* Slots whose entry was removed */
+  uint32_t free_entry;          /* First free entry slot, 0 if none */
+};
+
+#define DIR_INDEX_MAGIC 0x49524944
+#define DIR_INDEX_OFS 32
+
+/* A hash slot. Free entry slots are chained through the
+   inode_sector of their entries, starting at the header's
+   free_entry. */
+struct dir_index_slot
+{
+  uint32_t entry;               /* Entry slot + 1, 0 if never used */
+  uint32_t hash;                /* hash_string() of the entry's name */
+};
+
+/* Marks a hash slot whose entry was removed. */
+#define DIR_INDEX_REMOVED UINT32_MAX
+
 static bool lookup (const struct dir *dir, const char *name,
                     struct dir_entry *ep, off_t *ofsp);
+static bool linear_find (struct inode *dir, const char *name,
+                         struct dir_entry *ep, off_t *ofsp);
 static size_t dir_size (struct dir *dir);
+static off_t entry_ofs (uint32_t i);
+static block_sector_t index_sector (struct inode *dir);
+static struct inode *index_open (struct inode *dir,
+                                 struct dir_index_header *h);
+static bool index_find (struct inode *dir, struct inode *idx,
+                        const struct dir_index_header *h, const char *name,
+                        struct dir_entry *ep, uint32_t *entryp,
+                        uint32_t *slotp);
+static bool index_add (struct dir *dir, struct inode *idx,
+                       struct dir_index_header *h, const char *name,
+                       block_sector_t inode_sector);
+static bool index_remove (struct dir *dir, struct inode *idx,
+                          struct dir_index_header *h, const char *name,
+                          block_sector_t inode_sector);
+static bool index_build (struct inode *dir, struct inode *idx);
+static void index_upgrade (struct dir *dir);
 
 /* Creates a directory in the given SECTOR.  Returns true if successful, false
    on failure. */
@@ -37,8 +96,10 @@ dir_create (block_sector_t sector, block_sector_t parent)
   bool status;
   struct dir *dir;
 
-  /* Create sector with enough room for two entries */
-  status = inode_create (sector, 2 * sizeof (struct dir_entry), true);
+  /* Create sector with enough room for '.', '..' and the slot
+     reserved for an index */
+  status = inode_create (sector, (DIR_INDEX_SLOT + 1)
+                                 * sizeof (struct dir_entry), true);
 	
   if (!status) return status;
 
@@ -110,15 +171,41 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_index_header h;
+  struct inode *idx;
+  uint32_t entry, slot;
+  bool found;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
+  idx = index_open (dir->inode, &h);
+  if (idx != NULL)
+  {
+    found = index_find (dir->inode, idx, &h, name, ep, &entry, &slot);
+    inode_close (idx);
+    if (found && ofsp != NULL)
+      *ofsp = entry_ofs (entry);
+  }
+  else
+    found = linear_find (dir->inode, name, ep, ofsp);
+  rwlock_release_read (inode_dir_lock (dir->inode));
+  return found;
+}
+
+/* lookup() for a directory inode DIR without an index, reading
+   every entry. The directory lock must be held. */
+static bool
+linear_find (struct inode *dir, const char *name, struct dir_entry *ep,
+             off_t *ofsp)
+{
+  struct dir_entry e;
+  size_t ofs;
+
+  for (ofs = 0; inode_read_at (dir, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+    if (e.in_use && e.name[0] != '\0' && !strcmp (name, e.name)) 
     {
       if (ep != NULL)
         *ep = e;
@@ -137,16 +224,26 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent, sector;
   struct dir_entry e;
+  unsigned generation;
 
   ASSERT (dir != NULL);
 
+  parent = inode_get_inumber (dir->inode);
   if (name == NULL)
-    *inode = inode_open (inode_get_inumber (dir->inode));
-  else if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+    *inode = inode_open (parent);
+  else if (dcache_lookup (parent, name, &sector))
+    *inode = sector != INODE_INVALID_BLOCK_SECTOR ? inode_open (sector) : NULL;
   else
-    *inode = NULL;
+  {
+    generation = dcache_generation ();
+    sector = lookup (dir, name, &e, NULL) ? e.inode_sector
+                                          : INODE_INVALID_BLOCK_SECTOR;
+    if (!inode_is_removed (dir->inode))
+      dcache_insert (parent, name, sector, generation);
+    *inode = sector != INODE_INVALID_BLOCK_SECTOR ? inode_open (sector) : NULL;
+  }
 
   return *inode != NULL;
 }
@@ -160,6 +257,8 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index_header h;
+  struct inode *idx;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -173,11 +272,21 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 
   lock_acquire (&dir->l);
 
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  idx = index_open (dir->inode, &h);
+  if (idx != NULL)
+  {
+    success = index_add (dir, idx, &h, name, inode_sector);
+    inode_close (idx);
+    goto done;
+  }
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (linear_find (dir->inode, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
+  /* Set OFS to offset of free slot, other than the one reserved
+     for an index.
      If there are no free slots, then it will be set to the
      current end-of-file.
      
@@ -186,7 +295,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
      read due to something intermittent such as low memory. */
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
-    if (!e.in_use)
+    if (!e.in_use && ofs != entry_ofs (DIR_INDEX_SLOT))
       break;
 
   /* Write slot. */
@@ -194,7 +303,14 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+  if (success
+      && inode_length (dir->inode) >= DIR_INDEX_MIN * (off_t) sizeof e)
+    index_upgrade (dir);
 done:
+  rwlock_release_write (inode_dir_lock (dir->inode));
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
   lock_release (&dir->l);
   return success;
 }
@@ -205,8 +321,10 @@ done:
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index_header h;
   struct dir_entry e;
-  struct inode *inode = NULL;
+  struct inode *inode = NULL, *idx;
+  block_sector_t sector;
   bool success = false;
   off_t ofs;
 
@@ -234,13 +352,44 @@ dir_remove (struct dir *dir, const char *name)
       goto done;
   }
 
-  /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  /* Erase directory entry, unless another handle on the directory
+     removed or replaced it since it was looked up. */
+  rwlock_acquire_write (inode_dir_lock (dir->inode));
+  idx = index_open (dir->inode, &h);
+  if (idx != NULL)
+  {
+    success = index_remove (dir, idx, &h, name, e.inode_sector);
+    inode_close (idx);
+  }
+  else
+  {
+    sector = e.inode_sector;
+    success = linear_find (dir->inode, name, &e, &ofs)
+              && e.inode_sector == sector;
+    if (success)
+    {
+      e.in_use = false;
+      success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+    }
+  }
+  rwlock_release_write (inode_dir_lock (dir->inode));
+  if (!success)
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode, and the index of a directory along with it */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_is_directory (inode))
+    dcache_invalidate_dir (e.inode_sector);
   success = inode_remove (inode);
+  sector = inode_is_directory (inode) ? index_sector (inode)
+                                      : INODE_INVALID_BLOCK_SECTOR;
+  if (success && sector != INODE_INVALID_BLOCK_SECTOR)
+  {
+    idx = inode_open (sector);
+    if (idx != NULL)
+      inode_remove (idx);
+    inode_close (idx);
+  }
 
 done:
   lock_release (&dir->l);
@@ -253,21 +402,34 @@ done:
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  return dir_readdir_entry (dir, name, NULL);
+}
+
+/* Like dir_readdir(), but also stores the sector of the entry's
+   inode in *SECTORP if SECTORP is non-null. */
+bool
+dir_readdir_entry (struct dir *dir, char name[NAME_MAX + 1],
+                   block_sector_t *sectorp)
 {
   struct dir_entry e;
 
   bool result = false;
   lock_acquire (&dir->l);
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
   while (!result && 
       inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
   {
-    if (e.in_use)
+    if (e.in_use && e.name[0] != '\0')
     {
       strlcpy (name, e.name, NAME_MAX + 1);
+      if (sectorp != NULL)
+        *sectorp = e.inode_sector;
       result = true;
     } 
     dir->pos += sizeof e;
   }
+  rwlock_release_read (inode_dir_lock (dir->inode));
   lock_release (&dir->l);
   return result;
 }
@@ -299,7 +461,15 @@ dir_dirname (const char *path)
 struct dir *
 dir_open_path (const char *path)
 {
-  block_sector_t sector = path_traverse (path, NULL);
+  return dir_open_path_at (thread_get_cwd (), path);
+}
+
+/* Opens the directory for the given path, relative to the directory at
+ * sector BASE unless it is absolute. If the path is null, opens BASE */
+struct dir *
+dir_open_path_at (block_sector_t base, const char *path)
+{
+  block_sector_t sector = path_traverse_at (base, path, NULL);
   if (sector == INODE_INVALID_BLOCK_SECTOR) return NULL;
   struct dir *d = dir_open (inode_open (sector));
   if (inode_is_removed (d->inode)) return NULL;
@@ -309,14 +479,23 @@ dir_open_path (const char *path)
 /* Traverse -- if thread is non-NULL, update the path of the thread */
 block_sector_t
 path_traverse (char *path, struct thread *t)
+{
+  return path_traverse_at (thread_get_cwd (), path, t);
+}
+
+/* Traverses PATH starting from the directory at sector BASE, unless PATH
+   is absolute. */
+block_sector_t
+path_traverse_at (block_sector_t base, char *path, struct thread *t)
 {
   char *token, *save_ptr;
   bool found;
   struct dir dir;
   struct dir_entry entry;
-  block_sector_t sector;
+  block_sector_t sector, child;
+  unsigned generation;
 
-  if (path == NULL) return thread_get_cwd ();
+  if (path == NULL) return base;
 
   /* Check if absolute path */
   if (path[0] == '/')
@@ -325,7 +504,7 @@ path_traverse (char *path, struct thread *t)
     path++;
     if (t != NULL) thread_clear_dirs (t);
   } else {
-    sector = thread_get_cwd ();
+    sector = base;
   }
 
   for (token = strtok_r (path, "/", &save_ptr); token != NULL;
@@ -345,11 +524,19 @@ path_traverse (char *path, struct thread *t)
     if (t != NULL) 
       thread_leave_dir (t, dir.inode);
 
-    /* Look up in current directory */
-    found = lookup (&dir, token, &entry, NULL);
+    /* Look up in current directory, in the dentry cache first */
+    if (!dcache_lookup (sector, token, &child))
+    {
+      generation = dcache_generation ();
+      child = lookup (&dir, token, &entry, NULL) ? entry.inode_sector
+                                                 : INODE_INVALID_BLOCK_SECTOR;
+      if (!inode_is_removed (dir.inode))
+        dcache_insert (sector, token, child, generation);
+    }
+    found = child != INODE_INVALID_BLOCK_SECTOR;
     if (found)
     {
-      sector = entry.inode_sector;
+      sector = child;
 
       /* Make thread enter the directory if applicable */
       if (t != NULL)
@@ -391,18 +578,324 @@ dir_basename (const char *path)
 static size_t
 dir_size (struct dir *dir)
 {
+  struct dir_index_header h;
+  struct inode *idx;
   struct dir_entry e;
   size_t ofs;
   size_t count = 0;
 
   ASSERT (dir != NULL);
   lock_acquire (&dir->l);
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-  {
-    if (e.in_use)
-      count++;
-  }
+  rwlock_acquire_read (inode_dir_lock (dir->inode));
+  idx = index_open (dir->inode, &h);
+  if (idx != NULL)
+    count = h.used;
+  else
+    for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+    {
+      if (e.in_use && e.name[0] != '\0')
+        count++;
+    }
+  inode_close (idx);
+  rwlock_release_read (inode_dir_lock (dir->inode));
   lock_release (&dir->l);
   return count - 2;
 }
+
+/* Returns the byte offset of hash slot I in an index. */
+static off_t
+slot_ofs (uint32_t i)
+{
+  return DIR_INDEX_OFS + i * sizeof (struct dir_index_slot);
+}
+
+/* Returns the byte offset of entry slot I in a directory. */
+static off_t
+entry_ofs (uint32_t i)
+{
+  return i * sizeof (struct dir_entry);
+}
+
+/* Returns the sector of the index of the directory inode DIR, or
+   INODE_INVALID_BLOCK_SECTOR if it has none. */
+static block_sector_t
+index_sector (struct inode *dir)
+{
+  struct dir_entry e;
+
+  if (inode_read_at (dir, &e, sizeof e, entry_ofs (DIR_INDEX_SLOT))
+      == sizeof e && e.in_use && e.name[0] == '\0')
+    return e.inode_sector;
+  return INODE_INVALID_BLOCK_SECTOR;
+}
+
+/* Opens the index of the directory inode DIR and reads its header
+   into H. Returns a null pointer if DIR has no index or its index
+   is incomplete, in which case its entries must be searched one by
+   one. The caller must close the index. */
+static struct inode *
+index_open (struct inode *dir, struct dir_index_header *h)
+{
+  block_sector_t sector = index_sector (dir);
+  struct inode *idx;
+
+  if (sector == INODE_INVALID_BLOCK_SECTOR)
+    return NULL;
+  idx = inode_open (sector);
+  if (idx != NULL
+      && (inode_read_at (idx, h, sizeof *h, 0) != sizeof *h
+          || h->magic != DIR_INDEX_MAGIC))
+  {
+    inode_close (idx);
+    idx = NULL;
+  }
+  return idx;
+}
+
+/* Searches the index IDX of directory DIR, with header H, for
+   NAME. If found, returns true, sets *EP to its entry if EP is
+   non-null, *ENTRYP to the entry slot, and *SLOTP to the hash
+   slot. Otherwise returns false and sets *SLOTP to the hash slot
+   NAME would go in, or UINT32_MAX if the index is full. */
+static bool
+index_find (struct inode *dir, struct inode *idx,
+            const struct dir_index_header *h, const char *name,
+            struct dir_entry *ep, uint32_t *entryp, uint32_t *slotp)
+{
+  unsigned hash = hash_string (name);
+  uint32_t mask = h->size - 1;
+  uint32_t free_slot = UINT32_MAX;
+  struct dir_index_slot s;
+  struct dir_entry e;
+  uint32_t i, n;
+
+  for (i = hash & mask, n = 0; n < h->size; i = (i + 1) & mask, n++)
+  {
+    if (inode_read_at (idx, &s, sizeof s, slot_ofs (i)) != sizeof s)
+      break;
+    if (s.entry == 0)
+    {
+      if (free_slot == UINT32_MAX)
+        free_slot = i;
+      break;
+    }
+    if (s.entry == DIR_INDEX_REMOVED)
+    {
+      if (free_slot == UINT32_MAX)
+        free_slot = i;
+    }
+    else if (s.hash == hash
+             && inode_read_at (dir, &e, sizeof e, entry_ofs (s.entry - 1))
+                == sizeof e
+             && e.in_use && !strcmp (name, e.name))
+    {
+      if (ep != NULL)
+        *ep = e;
+      *entryp = s.entry - 1;
+      *slotp = i;
+      return true;
+    }
+  }
+
+  *slotp = free_slot;
+  return false;
+}
+
+/* Adds NAME, for the inode at INODE_SECTOR, to indexed directory
+   DIR, whose index IDX has header H. The entry goes in the first
+   free entry slot, or at the end. The index is rebuilt, and grown
+   if needed, once three quarters of its slots have been used. */
+static bool
+index_add (struct dir *dir, struct inode *idx, struct dir_index_header *h,
+           const char *name, block_sector_t inode_sector)
+{
+  struct dir_index_slot s;
+  struct dir_entry e;
+  uint32_t entry, slot;
+
+  if (index_find (dir->inode, idx, h, name, NULL, &entry, &slot)
+      || slot == UINT32_MAX
+      || inode_read_at (idx, &s, sizeof s, slot_ofs (slot)) != sizeof s)
+    return false;
+
+  /* Take an entry slot */
+  if (h->free_entry != 0)
+  {
+    entry = h->free_entry;
+    if (inode_read_at (dir->inode, &e, sizeof e, entry_ofs (entry))
+        != sizeof e)
+      return false;
+    h->free_entry = e.inode_sector;
+  }
+  else
+    entry = inode_length (dir->inode) / sizeof e;
+
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  if (inode_write_at (dir->inode, &e, sizeof e, entry_ofs (entry))
+      != sizeof e)
+    return false;
+
+  if (s.entry == DIR_INDEX_REMOVED)
+    h->removed--;
+  h->used++;
+  s.entry = entry + 1;
+  s.hash = hash_string (name);
+  if (inode_write_at (idx, &s, sizeof s, slot_ofs (slot)) != sizeof s
+      || inode_write_at (idx, h, sizeof *h, 0) != sizeof *h)
+    return false;
+
+  if ((h->used + h->removed) * 4 > h->size * 3)
+    index_build (dir->inode, idx);
+  return true;
+}
+
+/* Removes NAME, which must refer to the inode at INODE_SECTOR,
+   from indexed directory DIR, whose index IDX has header H, and
+   puts its entry slot on the free list. */
+static bool
+index_remove (struct dir *dir, struct inode *idx,
+              struct dir_index_header *h, const char *name,
+              block_sector_t inode_sector)
+{
+  struct dir_index_slot s;
+  struct dir_entry e;
+  uint32_t entry, slot;
+
+  if (!index_find (dir->inode, idx, h, name, &e, &entry, &slot)
+      || e.inode_sector != inode_sector)
+    return false;
+
+  e.in_use = false;
+  e.inode_sector = h->free_entry;
+  if (inode_write_at (dir->inode, &e, sizeof e, entry_ofs (entry))
+      != sizeof e)
+    return false;
+
+  s.entry = DIR_INDEX_REMOVED;
+  s.hash = 0;
+  h->free_entry = entry;
+  h->used--;
+  h->removed++;
+  return inode_write_at (idx, &s, sizeof s, slot_ofs (slot)) == sizeof s
+         && inode_write_at (idx, h, sizeof *h, 0) == sizeof *h;
+}
+
+/* Rebuilds the index IDX of directory DIR from its entries, with
+   at least twice as many hash slots as entries, and chains its
+   free entry slots together. The header is written last, so an
+   index left incomplete by a failure is not used. */
+static bool
+index_build (struct inode *dir, struct inode *idx)
+{
+  struct dir_index_header h;
+  struct dir_index_slot s;
+  struct dir_entry e;
+  uint32_t cnt, i, j, mask;
+  uint8_t *zeros;
+  off_t ofs, end;
+
+  cnt = inode_length (dir) / sizeof e;
+  memset (&h, 0, sizeof h);
+  for (h.size = DIR_INDEX_MIN; h.size < 2 * cnt; h.size *= 2)
+    continue;
+  mask = h.size - 1;
+
+  /* Clear the header and the slots */
+  zeros = calloc (1, BLOCK_SECTOR_SIZE);
+  if (zeros == NULL)
+    return false;
+  end = slot_ofs (h.size);
+  for (ofs = 0; ofs < end; ofs += BLOCK_SECTOR_SIZE)
+    if (inode_write_at (idx, zeros, end - ofs < BLOCK_SECTOR_SIZE
+                        ? end - ofs : BLOCK_SECTOR_SIZE, ofs) <= 0)
+    {
+      free (zeros);
+      return false;
+    }
+  free (zeros);
+
+  for (i = 0; inode_read_at (dir, &e, sizeof e, entry_ofs (i)) == sizeof e;
+       i++)
+  {
+    if (i == DIR_INDEX_SLOT)
+      continue;
+    if (!e.in_use)
+    {
+      e.inode_sector = h.free_entry;
+      if (inode_write_at (dir, &e, sizeof e, entry_ofs (i)) != sizeof e)
+        return false;
+      h.free_entry = i;
+      continue;
+    }
+
+    s.entry = i + 1;
+    s.hash = hash_string (e.name);
+    for (j = s.hash & mask; ; j = (j + 1) & mask)
+    {
+      struct dir_index_slot t;
+      if (inode_read_at (idx, &t, sizeof t, slot_ofs (j)) != sizeof t)
+        return false;
+      if (t.entry == 0)
+        break;
+    }
+    if (inode_write_at (idx, &s, sizeof s, slot_ofs (j)) != sizeof s)
+      return false;
+    h.used++;
+  }
+
+  h.magic = DIR_INDEX_MAGIC;
+  return inode_write_at (idx, &h, sizeof h, 0) == sizeof h;
+}
+
+/* Gives directory DIR a hash index, or rebuilds the one it has if
+   it was left incomplete. The directory lock must be held for
+   writing. The index goes in the entry slot DIR_INDEX_SLOT; a
+   directory created before that slot was reserved may have an
+   entry there, and is then left to be searched one entry at a time,
+   as it is on failure. */
+static void
+index_upgrade (struct dir *dir)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  block_sector_t sector;
+  struct dir_entry e;
+  struct inode *idx;
+
+  if (inode_read_at (dir->inode, &e, sizeof e, entry_ofs (DIR_INDEX_SLOT))
+      != sizeof e || (e.in_use && e.name[0] != '\0'))
+    return;
+
+  if (e.in_use)
+    sector = e.inode_sector;
+  else
+  {
+    if (!free_map_allocate_near (1, dir_sector, &sector))
+      return;
+    if (!inode_create (sector, 0, false))
+    {
+      free_map_release (sector, 1);
+      return;
+    }
+
+    memset (&e, 0, sizeof e);
+    e.in_use = true;
+    e.inode_sector = sector;
+    if (inode_write_at (dir->inode, &e, sizeof e, entry_ofs (DIR_INDEX_SLOT))
+        != sizeof e)
+    {
+      idx = inode_open (sector);
+      if (idx != NULL)
+        inode_remove (idx);
+      inode_close (idx);
+      return;
+    }
+  }
+
+  idx = inode_open (sector);
+  if (idx != NULL)
+    index_build (dir->inode, idx);
+  inode_close (idx);
+}
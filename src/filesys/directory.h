@@ -30,11 +30,16 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_readdir_entry (struct dir *, char name[NAME_MAX + 1],
+                        block_sector_t *);
 
 /* Path traversal */
 char *dir_dirname (const char *path);
 struct dir *dir_open_path (const char *path);
+struct dir *dir_open_path_at (block_sector_t base, const char *path);
 const char *dir_basename (const char *path);
 block_sector_t path_traverse (char *path, struct thread *t);
+block_sector_t path_traverse_at (block_sector_t base, char *path,
+                                 struct thread *t);
 
 #endif /* filesys/directory.h */
@@ -1,20 +1,39 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <dirent.h>
+#include "filesys/buffercache.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds of the readahead window. The window starts at the minimum
+   once reads turn sequential and doubles with every sequential read
+   up to the maximum, which is kept to a quarter of the buffer cache. */
+#define FILE_READAHEAD_MIN (2 * BLOCK_SECTOR_SIZE)
+#define FILE_READAHEAD_MAX (BUFFERCACHE_SIZE / 4 * BLOCK_SECTOR_SIZE)
+
+/* Sequential readahead state of an open file. */
+struct file_readahead
+{
+  off_t next;                 /* Offset a sequential read starts at. */
+  off_t window;               /* Bytes to read ahead, 0 if random. */
+  off_t issued;               /* End of the readahead issued so far. */
+};
+
 /* An open file. */
 struct file 
 {
   struct inode *inode;        /* File's inode. */
   off_t pos;                  /* Current position. */
   bool deny_write;            /* Has file_deny_write() been called? */
+  struct file_readahead ra;   /* Readahead state. */
   
   struct dir *dir;            /* Should only be non-null if the file
                                  is a directory */
 };
 
+static void file_readahead (struct file *, off_t ofs, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -75,6 +94,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  file_readahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -87,7 +107,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  file_readahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -120,6 +142,25 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Writes FILE's data that is still only in the buffer cache to
+   disk. */
+void
+file_sync (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_sync (file->inode);
+}
+
+/* Allocates disk space for the first LENGTH bytes of FILE,
+   extending FILE to LENGTH bytes if it is shorter. Returns true
+   if successful, false if the disk is full. */
+bool
+file_allocate (struct file *file, off_t length)
+{
+  ASSERT (file != NULL);
+  return inode_allocate (file->inode, length);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -190,6 +231,46 @@ file_is_directory (struct file *file)
   return file->dir != NULL;
 }
 
+/* Updates FILE's readahead state after BYTES_READ bytes were read
+   at offset OFS and issues readahead for the current window.  A
+   read that continues where the last one ended grows the window;
+   any other read halves it, so that once access turns random
+   readahead stops altogether. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  struct file_readahead *ra = &file->ra;
+  off_t start, end;
+
+  if (bytes_read <= 0)
+    return;
+
+  if (ofs == ra->next)
+  {
+    ra->window = ra->window == 0 ? FILE_READAHEAD_MIN : ra->window * 2;
+    if (ra->window > FILE_READAHEAD_MAX)
+      ra->window = FILE_READAHEAD_MAX;
+  } else {
+    ra->window /= 2;
+    if (ra->window < FILE_READAHEAD_MIN)
+      ra->window = 0;
+    ra->issued = ofs;
+  }
+  ra->next = ofs + bytes_read;
+
+  if (ra->window == 0)
+    return;
+
+  /* Only ask for the part of the window not already issued */
+  start = ra->issued > ra->next ? ra->issued : ra->next;
+  end = ra->next + ra->window;
+  if (start < end)
+  {
+    inode_readahead (file->inode, start, end - start);
+    ra->issued = end;
+  }
+}
+
 /* Invokes readdir on the directory */
 bool
 file_readdir (struct file *file, char *name)
@@ -198,3 +279,30 @@ file_readdir (struct file *file, char *name)
   bool success = dir_readdir (file->dir, name);
   return success;
 }
+
+/* Reads up to CNT of the next entries of the directory into
+   ENTRIES, along with the inode number, type and length of each,
+   and returns how many were read. Each entry's inode is opened to
+   read its type and length, after the directory lock is dropped;
+   recently used inodes are found in the inode table without I/O. */
+int
+file_readdir_plus (struct file *file, struct dirent *entries, int cnt)
+{
+  block_sector_t sector;
+  struct inode *inode;
+  int n;
+
+  if (file->dir == NULL) return 0;
+  for (n = 0; n < cnt; n++)
+  {
+    struct dirent *d = &entries[n];
+    if (!dir_readdir_entry (file->dir, d->name, &sector))
+      break;
+    inode = inode_open (sector);
+    d->inumber = sector;
+    d->is_dir = inode != NULL && inode_is_directory (inode);
+    d->length = inode != NULL ? inode_length (inode) : 0;
+    inode_close (inode);
+  }
+  return n;
+}
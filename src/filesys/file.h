@@ -5,6 +5,7 @@
 #include <stdbool.h>
 
 struct inode;
+struct dirent;
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
@@ -17,6 +18,8 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+void file_sync (struct file *);
+bool file_allocate (struct file *, off_t length);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -33,5 +36,6 @@ int file_inumber (struct file *);
 /* Directory items. */
 bool file_is_directory (struct file *);
 bool file_readdir (struct file *, char *);
+int file_readdir_plus (struct file *, struct dirent *, int cnt);
 
 #endif /* filesys/file.h */
@@ -5,6 +5,7 @@
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "filesys/buffercache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -25,6 +26,7 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dcache_init ();
   free_map_init ();
   if (!buffercache_init (BUFFERCACHE_SIZE))
     PANIC ("Could not create buffer cache, can't initialize file system.");
@@ -50,14 +52,24 @@ filesys_done (void)
    or if internal memory allocation fails. */
 bool
 filesys_create (const char *path, off_t initial_size) 
+{
+  return filesys_create_at (thread_get_cwd (), path, initial_size);
+}
+
+/* Like filesys_create(), but a relative PATH is looked up from the
+   directory at sector BASE instead of the current directory. */
+bool
+filesys_create_at (block_sector_t base, const char *path, off_t initial_size)
 {
   block_sector_t inode_sector = 0;
   char *dirname = dir_dirname (path);
   const char *basename = dir_basename (path);
-  struct dir *dir = dir_open_path (dirname);
+  struct dir *dir = dir_open_path_at (base, dirname);
   bool success = (dir != NULL
                   && basename != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (1,
+                         inode_get_inumber (dir_get_inode (dir)),
+                         &inode_sector)
                   && inode_create (inode_sector, initial_size, false)
                   && dir_add (dir, basename, inode_sector));
   if (!success && inode_sector != 0) 
@@ -71,14 +83,24 @@ filesys_create (const char *path, off_t initial_size)
  * otherwise. Requires parent directories to exist */
 bool
 filesys_mkdir (const char *path)
+{
+  return filesys_mkdir_at (thread_get_cwd (), path);
+}
+
+/* Like filesys_mkdir(), but a relative PATH is looked up from the
+   directory at sector BASE instead of the current directory. */
+bool
+filesys_mkdir_at (block_sector_t base, const char *path)
 {
   block_sector_t newdir_sector = 0;
   char *dirname = dir_dirname (path);
   const char *basename = dir_basename (path);
-  struct dir *dir = dir_open_path (dirname);
+  struct dir *dir = dir_open_path_at (base, dirname);
   bool success = (dir != NULL
                   && basename != NULL
-                  && free_map_allocate (1, &newdir_sector)
+                  && free_map_allocate_near (1,
+                         inode_get_inumber (dir_get_inode (dir)),
+                         &newdir_sector)
                   && dir_create (newdir_sector, inode_get_inumber
                                  (dir_get_inode (dir)))
                   && dir_add (dir, basename, newdir_sector));
@@ -96,12 +118,20 @@ filesys_mkdir (const char *path)
    or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *path)
+{
+  return filesys_open_at (thread_get_cwd (), path);
+}
+
+/* Like filesys_open(), but a relative PATH is looked up from the
+   directory at sector BASE instead of the current directory. */
+struct file *
+filesys_open_at (block_sector_t base, const char *path)
 {
   if (strlen (path) == 0) return NULL;
 
   char *dirname = dir_dirname (path);
   const char *basename = dir_basename (path);
-  struct dir *dir = dir_open_path (dirname);
+  struct dir *dir = dir_open_path_at (base, dirname);
   if (dirname != NULL) free (dirname);
 
   struct inode *inode = NULL;
@@ -118,10 +148,18 @@ filesys_open (const char *path)
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *path) 
+{
+  return filesys_remove_at (thread_get_cwd (), path);
+}
+
+/* Like filesys_remove(), but a relative PATH is looked up from the
+   directory at sector BASE instead of the current directory. */
+bool
+filesys_remove_at (block_sector_t base, const char *path)
 {
   char *dirname = dir_dirname (path);
   const char *basename = dir_basename (path);
-  struct dir *dir = dir_open_path (dirname);
+  struct dir *dir = dir_open_path_at (base, dirname);
   if (dirname != NULL) free (dirname);
 
   bool success = false;
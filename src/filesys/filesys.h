@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
+#include "devices/block.h"
 
 /* Block device that contains the file system. */
 struct block *fs_device;
@@ -14,4 +15,11 @@ bool filesys_mkdir (const char *path);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
 
+/* Variants that look up relative paths from the directory at the
+   given sector instead of the current directory. */
+bool filesys_create_at (block_sector_t, const char *, off_t initial_size);
+bool filesys_mkdir_at (block_sector_t, const char *path);
+struct file *filesys_open_at (block_sector_t, const char *);
+bool filesys_remove_at (block_sector_t, const char *);
+
 #endif /* filesys/filesys.h */
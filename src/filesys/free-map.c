@@ -1,21 +1,88 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
 #include "threads/thread.h"
+#include "threads/malloc.h"
+#include "filesys/buffercache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 
+/* Number of sectors whose bits share one free map sector. */
+#define FREE_MAP_BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* Number of sectors in an allocation group, 256 kB. */
+#define FREE_MAP_GROUP_SIZE 512
+
 static struct bitmap *free_map;    /* Free map, one bit per sector. */
 static block_sector_t free_map_begin;
 static block_sector_t free_map_end;
 static block_sector_t root_dir_sector;
 static struct lock free_map_lock;
 
-static bool 
-free_map_write (void)
+/* Sectors released since the last free_map_flush(), and how many.
+   They stay marked in FREE_MAP, so that they are neither handed
+   out again nor shown as free on disk until the metadata that
+   pointed to them has reached the disk. A crash before then can
+   only leak them, never give them to two files. */
+static struct bitmap *released;
+static size_t released_cnt;
+
+/* Sectors being made free by the free_map_flush() in progress,
+   which swaps them with RELEASED. FLUSH_LOCK serializes flushes;
+   it is not held by allocation or release. */
+static struct bitmap *releasing;
+static struct lock flush_lock;
+
+/* The disk is divided into groups of FREE_MAP_GROUP_SIZE sectors,
+   and allocations are made in the group of a sector the caller
+   wants them near, so that inodes end up close to their directory
+   and data close to its inode. Each group has a next-fit cursor,
+   the sector to start searching it from. */
+static size_t group_cnt;
+static block_sector_t *group_cursor;
+
+/* Returns the group SECTOR is in. */
+static inline size_t
+group_of (block_sector_t sector)
 {
-  return bitmap_write (free_map, free_map_begin);
+  return sector / FREE_MAP_GROUP_SIZE;
+}
+
+/* Writes free map sector IDX into the buffer cache. */
+static bool
+free_map_write_sector (size_t idx)
+{
+  uint8_t *buf = malloc (BLOCK_SECTOR_SIZE);
+  bool success = false;
+
+  if (buf == NULL)
+    return false;
+  bitmap_get_sector (free_map, idx, buf);
+  success = buffercache_write (free_map_begin + idx, METADATA,
+                               free_map_begin, 0, BLOCK_SECTOR_SIZE,
+                               buf) == BLOCK_SECTOR_SIZE;
+  free (buf);
+  return success;
+}
+
+/* Writes the free map sectors holding the bits of the CNT sectors
+   starting at SECTOR into the buffer cache. The buffer cache writes
+   dirty free map sectors back ahead of any other sector, so they
+   reach the disk before the metadata that points to the sectors
+   allocated in them. */
+static bool
+free_map_write (block_sector_t sector, size_t cnt)
+{
+  size_t idx;
+
+  for (idx = sector / FREE_MAP_BITS_PER_SECTOR;
+       idx <= (sector + cnt - 1) / FREE_MAP_BITS_PER_SECTOR; idx++)
+    if (!free_map_write_sector (idx))
+      return false;
+  return true;
 }
 
 static bool
@@ -44,7 +111,19 @@ free_map_init (void)
   free_map_begin = FREE_MAP_SECTOR_BEGIN;
   free_map_end = free_map_begin + num_sectors;
 
+  released = bitmap_create (bitmap_size (free_map));
+  releasing = bitmap_create (bitmap_size (free_map));
+  if (released == NULL || releasing == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+
   block_sector_t i;
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), FREE_MAP_GROUP_SIZE);
+  group_cursor = malloc (group_cnt * sizeof *group_cursor);
+  if (group_cursor == NULL)
+    PANIC ("can't allocate free map groups");
+  for (i = 0; i < group_cnt; i++)
+    group_cursor[i] = i * FREE_MAP_GROUP_SIZE;
+
   for (i = free_map_begin; i < free_map_end; i++)
     bitmap_mark (free_map, i);
 
@@ -56,6 +135,7 @@ free_map_init (void)
   thread_set_cwd (root_dir_sector);
 
   lock_init (&free_map_lock);
+  lock_init (&flush_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -66,32 +146,154 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but places the sectors as close after
+   sector NEAR as it can: in its group from the group's cursor on,
+   then in the groups after it, and only then wrapping around to
+   the start of the disk. If that fails while released sectors are
+   waiting for a flush, flushes and tries again. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t near,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector;
+  bool pending, flushed = false;
+  size_t g;
+
+ retry:
   lock_acquire (&free_map_lock);
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  g = group_of (near) < group_cnt ? group_of (near) : 0;
+  sector = bitmap_scan (free_map, group_cursor[g], cnt, false);
+  if (sector == BITMAP_ERROR && group_cursor[g] > 0)
+    sector = bitmap_scan (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
+  {
+    bitmap_set_multiple (free_map, sector, cnt, true);
+    g = group_of (sector);
+    if (group_cursor[g] <= sector)
+      group_cursor[g] = sector + cnt;
+  }
   if (sector != BITMAP_ERROR
-      && !free_map_write ())
+      && !free_map_write (sector, cnt))
   {
     bitmap_set_multiple (free_map, sector, cnt, false); 
     sector = BITMAP_ERROR;
   }
+  pending = released_cnt > 0;
   lock_release (&free_map_lock);
 
+  if (sector == BITMAP_ERROR && pending && !flushed)
+  {
+    free_map_flush ();
+    flushed = true;
+    goto retry;
+  }
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates as many of the CNT sectors starting at SECTOR as are
+   free, stopping at the first one that is in use, and returns
+   how many were allocated.  Used to grow a run of sectors in
+   place. */
+size_t
+free_map_allocate_at (block_sector_t sector, size_t cnt)
+{
+  size_t n = 0;
+
+  lock_acquire (&free_map_lock);
+  while (n < cnt && sector + n < bitmap_size (free_map)
+         && !bitmap_test (free_map, sector + n))
+    n++;
+  if (n > 0)
+  {
+    bitmap_set_multiple (free_map, sector, n, true);
+    if (!free_map_write (sector, n))
+    {
+      bitmap_set_multiple (free_map, sector, n, false);
+      n = 0;
+    }
+  }
+  lock_release (&free_map_lock);
+
+  return n;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use once
+   the next free_map_flush() has written the metadata that pointed
+   to them. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   lock_acquire (&free_map_lock);
 
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  free_map_write ();
+  ASSERT (bitmap_none (released, sector, cnt));
+  bitmap_set_multiple (released, sector, cnt, true);
+  released_cnt += cnt;
+
+  lock_release (&free_map_lock);
+}
+
+/* Writes everything in the buffer cache to disk, then makes the
+   sectors released before it free, writing the free map sectors
+   that change into the buffer cache. Allocation and release go on
+   while the cache is flushed; sectors released meanwhile wait for
+   the next flush. Does nothing if no sectors have been released.
+   Called periodically by the buffer cache cleaner. */
+void
+free_map_flush (void)
+{
+  struct bitmap *swap;
+  size_t sector, idx = SIZE_MAX;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&free_map_lock);
+  if (released_cnt == 0)
+  {
+    lock_release (&free_map_lock);
+    lock_release (&flush_lock);
+    return;
+  }
+  swap = releasing;
+  releasing = released;
+  released = swap;
+  released_cnt = 0;
+  lock_release (&free_map_lock);
+
+  buffercache_flush (true);
 
+  /* Free the sectors in ascending order, writing each free map
+     sector once its last change is made */
+  lock_acquire (&free_map_lock);
+  for (sector = bitmap_scan (releasing, 0, 1, true);
+       sector != BITMAP_ERROR;
+       sector = bitmap_scan (releasing, sector + 1, 1, true))
+  {
+    if (idx != SIZE_MAX && idx != sector / FREE_MAP_BITS_PER_SECTOR
+        && !free_map_write_sector (idx))
+      PANIC ("can't write free map");
+    idx = sector / FREE_MAP_BITS_PER_SECTOR;
+    bitmap_reset (releasing, sector);
+    bitmap_reset (free_map, sector);
+    if (group_cursor[group_of (sector)] > sector)
+      group_cursor[group_of (sector)] = sector;
+  }
+  if (idx != SIZE_MAX && !free_map_write_sector (idx))
+    PANIC ("can't write free map");
   lock_release (&free_map_lock);
+  lock_release (&flush_lock);
+}
+
+/* Writes the sectors of the free map in the buffer cache to disk,
+   so that blocks allocated so far are marked in use on disk. */
+void
+free_map_sync (void)
+{
+  buffercache_sync (free_map_begin);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -110,9 +312,9 @@ free_map_open (void)
 void
 free_map_close (void) 
 {
-  lock_acquire (&free_map_lock);
-  free_map_write ();
-  lock_release (&free_map_lock);
+  buffercache_flush (true);
+  free_map_flush ();
+  free_map_sync ();
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -123,8 +325,10 @@ free_map_create (void)
   lock_acquire (&free_map_lock);
 
   /* Write bitmap to file. */
-  if (!free_map_write ())
-    PANIC ("can't write free map");
+  size_t idx;
+  for (idx = 0; idx < free_map_end - free_map_begin; idx++)
+    if (!free_map_write_sector (idx))
+      PANIC ("can't write free map");
 
   lock_release (&free_map_lock);
 }
@@ -1,5 +1,6 @@
 #include "filesys/inode.h"
 #include <stdio.h>
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -28,26 +29,148 @@
 #define INODE_INDIRECT_INDEX_BASE INODE_CONSISTENT_BLOCKS
 #define INODE_DUBINDER_INDEX_BASE (INODE_CONSISTENT_BLOCKS+INODE_NUM_INDIRECT_BLOCKS)
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* The number of block pointers in a radix inode, and in each of
+   its index blocks */
+#define INODE_RADIX_ROOT 124
+#define INODE_RADIX_FANOUT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* The number of extents that fit in an inode */
+#define INODE_NUM_EXTENTS 61
+
+/* Most blocks allocated ahead of an appending write */
+#define INODE_PREALLOC_MAX 32
+
+/* The number of closed inodes kept in memory */
+#define INODE_CACHE_SIZE 64
+
+/* The number of block runs cached on each open inode */
+#define INODE_MAP_CACHE_SIZE 8
+
+/* How an inode maps file blocks to sectors */
+#define INODE_INDIRECT 0        /* Direct, indirect and doubly indirect */
+#define INODE_EXTENTS 1         /* Runs of contiguous sectors */
+#define INODE_INLINE 2          /* No blocks, data is in the inode */
+#define INODE_RADIX 3           /* Tree of index blocks of any depth */
+
+/* Largest file whose data fits in its inode */
+#define INODE_INLINE_SIZE (INODE_NUM_BLOCKS * sizeof (block_sector_t))
+
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. Up to INODE_CACHE_SIZE
+   inodes that are no longer open stay in the table too, so that
+   reopening them does not read them in again; CLOSED_INODES orders
+   them from least to most recently closed. OPEN_INODES_LOCK
+   protects all of these, along with each inode's OPEN_CNT and BUSY.
+   No disk I/O is done while holding it: an inode being read in or
+   written out on its last close is marked busy instead, and
+   inode_open() waits on INODES_SETTLED for that to finish. */
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock open_inodes_lock;
+static struct condition inodes_settled;
+
+/* A run of COUNT contiguous sectors starting at START. */
+struct inode_extent
+{
+  block_sector_t start;         /* First sector of the run */
+  uint32_t count;               /* Number of sectors in the run */
+};
+
+/* The block map of an INODE_EXTENTS inode: file blocks are the
+   sectors of the first CNT extents, in order.
+
+   Only the first INITIALIZED blocks have ever been written. The
+   others were allocated ahead of time, are not zeroed on disk and
+   read as zeros; they are zeroed as writes reach them. */
+struct inode_extent_table
+{
+  uint32_t cnt;                 /* Extents in use */
+  uint32_t initialized;         /* Blocks holding data */
+  struct inode_extent e[INODE_NUM_EXTENTS];
+};
+
+/* The block map of an INODE_RADIX inode. At depth 0 the ROOT
+   pointers are the file's data blocks; at depth N + 1 each points
+   to an index block of INODE_RADIX_FANOUT pointers that maps the
+   file blocks a pointer of a depth N tree would. A tree is made one
+   deeper, by moving ROOT into an index block, when the file outgrows
+   it, so a block is found with as many reads as the tree is deep,
+   which grows with the logarithm of the file size. Missing blocks
+   are INODE_INVALID_BLOCK_SECTOR and read as zeros. */
+struct inode_radix
+{
+  uint32_t depth;               /* Levels of index blocks */
+  block_sector_t root[INODE_RADIX_ROOT];
+};
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
 {
-  /* All of the inode blocks contains INODE_CONSISTENT_BLOCKS of 
-     blocks for the next level of indirection. The root block uses
-     INODE_CONSISTENT_BLOCKS + 1 for the singly indirect block and
-     INODE_CONSISTENT_BLOCKS + 2 for the doubly indirect block */
-  block_sector_t sectors[INODE_NUM_BLOCKS];
+  union
+  {
+    /* INODE_INDIRECT: All of the inode blocks contains
+       INODE_CONSISTENT_BLOCKS of blocks for the next level of
+       indirection. The root block uses INODE_CONSISTENT_BLOCKS + 1
+       for the singly indirect block and INODE_CONSISTENT_BLOCKS + 2
+       for the doubly indirect block */
+    block_sector_t sectors[INODE_NUM_BLOCKS];
+
+    /* INODE_EXTENTS */
+    struct inode_extent_table extents;
+
+    /* INODE_RADIX */
+    struct inode_radix radix;
+
+    /* INODE_INLINE: the file's data, zeros past its length */
+    uint8_t data[INODE_INLINE_SIZE];
+  };
   off_t length;                 /* File size in bytes. */
   bool directory;               /* true if this inode represents a directory */
-  uint8_t padding[3];           /* padding */
+  uint8_t format;               /* INODE_INDIRECT, _EXTENTS, _INLINE
+                                   or _RADIX */
+  uint8_t padding[2];           /* padding */
   unsigned magic;               /* Magic number. */
 };
 
 void inode_sector_free_map_fn (block_sector_t sector, bool meta);
+static void inode_write_length (struct inode *inode);
+static bool inode_reclaim (void);
+static block_sector_t indirect_byte_to_sector (struct inode *root, off_t pos,
+                                               bool create_final,
+                                               off_t keep_end,
+                                               block_sector_t leaf);
+static block_sector_t locked_byte_to_sector (struct inode *root, off_t pos,
+                                             bool create, off_t keep_end);
+static block_sector_t extent_byte_to_sector (struct inode *root, off_t pos,
+                                             bool create);
+static block_sector_t extent_lookup (struct inode *root, size_t idx);
+static bool extent_allocate (struct inode_disk *d, size_t first,
+                             size_t sectors, block_sector_t owner);
+static void extent_grow (struct inode *root, size_t first, size_t sectors,
+                         bool ahead);
+static void extent_initialize (struct inode *root, size_t idx,
+                               off_t keep_ofs, off_t keep_end);
+static void extent_trim (struct inode *root);
+static void extent_to_radix (struct inode *root, struct inode_disk *d);
+static block_sector_t radix_byte_to_sector (struct inode *root, off_t pos,
+                                            bool create, off_t keep_end,
+                                            block_sector_t leaf);
+static void radix_release (struct inode *root);
+static void extent_release (struct inode *root);
+static bool inline_to_extents (struct inode *root);
+static block_sector_t map_lookup (struct inode *root, size_t idx);
+static void map_insert (struct inode *root, size_t base,
+                        block_sector_t start, size_t count);
+static void map_clear (struct inode *root);
+static void map_change_begin (struct inode *root);
+static void map_change_end (struct inode *root);
+static void zero_sector_except (block_sector_t sector, off_t pos,
+                                off_t keep_ofs, off_t keep_end,
+                                block_sector_t owner);
+static void zero_sectors (block_sector_t sector, size_t cnt,
+                          block_sector_t owner);
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -57,17 +180,51 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Returns the number of file blocks the extents of T map. */
+static size_t
+sectors_mapped (const struct inode_extent_table *t)
+{
+  size_t mapped = 0;
+  uint32_t i;
+
+  for (i = 0; i < t->cnt; i++)
+    mapped += t->e[i].count;
+  return mapped;
+}
+
+/* A run of COUNT file blocks starting at block BASE that are held
+   in the COUNT sectors starting at START, cached on an open inode so
+   that resolving them does not read index blocks. */
+struct inode_map
+{
+  size_t base;                  /* First file block */
+  block_sector_t start;         /* Sector holding block BASE */
+  size_t count;                 /* Blocks in the run, 0 if unused */
+};
+
 /* In-memory inode. */
 struct inode {
   block_sector_t disk_block;    /* Sector of this inode on disk*/
-  struct list_elem elem;        /* Element in inode list. */
+  struct hash_elem elem;        /* Element in open_inodes. */
+  struct list_elem closed_elem; /* Element in closed_inodes if closed. */
   off_t length;
   bool directory;               /* true if this inode represents a directory */
+  uint8_t format;               /* INODE_INDIRECT, _EXTENTS, _INLINE
+                                   or _RADIX */
+  size_t initialized;           /* Blocks holding data, see
+                                   struct inode_extent_table */
   int open_cnt;                 /* Number of openers. */
+  bool busy;                    /* Being read in or closed. */
   bool removed;                 /* True if deleted, false otherwise. */
   int deny_write_cnt;           /* 0: writes ok, >0: deny writes. */
   int deny_remove_cnt;          /* 0: removes ok, >0: deny removes.*/
-  struct lock lock;
+  struct rwlock lock;           /* Shared to look blocks up, exclusive
+                                   to allocate them or change fields */
+  struct rwlock dir_lock;       /* Directory index, see directory.c */
+  struct lock map_lock;         /* Serializes changes to MAP */
+  unsigned map_seq;             /* Odd while MAP is being changed */
+  struct inode_map map[INODE_MAP_CACHE_SIZE]; /* Resolved block runs */
+  int map_next;                 /* Slot in MAP to replace next */
 };
 
 static off_t index_to_offset (int index)
@@ -76,35 +233,49 @@ static off_t index_to_offset (int index)
     + index*sizeof (block_sector_t);
 }
 
+/* Allocates a sector for index INDEX of CUR_SECTOR, an index block
+   of the inode at OWNER, and installs it there. A data block holds
+   the file bytes around POS and is zeroed except for the bytes from
+   POS up to KEEP_END, which the caller is about to write. */
 static block_sector_t 
 create_new_sector (block_sector_t cur_sector, int index, 
-    enum sector_type type)
+    enum sector_type type, block_sector_t owner, off_t pos, off_t keep_end)
 {
   off_t offset = index_to_offset (index);
   block_sector_t new_sector;
-  bool allocated = free_map_allocate (1, &new_sector);
+  block_sector_t *kernel_block = NULL;
+  bool allocated = free_map_allocate_near (1, cur_sector, &new_sector);
   if (!allocated) return -1;
 
-  /* Update the current sector info */
-  int bytes_written = buffercache_write (cur_sector, METADATA, offset,
-                                         sizeof (block_sector_t), &new_sector,
-                                         INODE_INVALID_BLOCK_SECTOR);
-  if (bytes_written != sizeof(block_sector_t)) return -1;
-
-  /* Correctly initialize the new sector -- it should either
-     be all zeros if it is newly created or filled with 
-     INODE_INVALID_BLOCK_SECTOR otherwise */
-  int fill = (type == METADATA) ? INODE_INVALID_BLOCK_SECTOR : 0;
-  unsigned j;
-  
-  int *kernel_block = (int*)malloc (BLOCK_SECTOR_SIZE);
-  for (j = 0; j < BLOCK_SECTOR_SIZE/sizeof(int); j++)
-    kernel_block[j] = fill;
-
-  buffercache_write (new_sector, type, 0, BLOCK_SECTOR_SIZE,
-                     kernel_block, INODE_INVALID_BLOCK_SECTOR);
+  /* Correctly initialize the new sector before it is installed -- a
+     data block is only created when it is written to, so it only
+     needs zeroing around the write; an index block is filled with
+     INODE_INVALID_BLOCK_SECTOR */
+  if (type != METADATA)
+    zero_sector_except (new_sector, pos - pos % BLOCK_SECTOR_SIZE, pos,
+                        keep_end, owner);
+  else
+  {
+    kernel_block = malloc (BLOCK_SECTOR_SIZE);
+    if (kernel_block == NULL)
+    {
+      free_map_release (new_sector, 1);
+      return -1;
+    }
+    memset (kernel_block, INODE_INVALID_BLOCK_SECTOR, BLOCK_SECTOR_SIZE);
+    buffercache_write (new_sector, type, owner, 0, BLOCK_SECTOR_SIZE,
+                       kernel_block);
+    free (kernel_block);
+  }
 
-  free (kernel_block);
+  /* Update the current sector info */
+  int bytes_written = buffercache_write (cur_sector, METADATA, owner, offset,
+                                         sizeof (block_sector_t), &new_sector);
+  if (bytes_written != sizeof(block_sector_t))
+  {
+    free_map_release (new_sector, 1);
+    return -1;
+  }
 
   return new_sector;
 }
@@ -118,8 +289,7 @@ get_sector_from_block (block_sector_t sector, int index)
   off_t offset = index_to_offset (index);
   block_sector_t next_sector;
   int bytes_read = buffercache_read (sector, METADATA, offset,
-      sizeof (block_sector_t), &next_sector,
-      INODE_INVALID_BLOCK_SECTOR); 
+      sizeof (block_sector_t), &next_sector);
 
   if (bytes_read != sizeof (block_sector_t)) 
     return INODE_INVALID_BLOCK_SECTOR;
@@ -128,10 +298,12 @@ get_sector_from_block (block_sector_t sector, int index)
 }
 
 /* Returns the sector at index if it is a valid sector or if create is 
-   true */
+   true. Created sectors belong to the inode at OWNER; a created data
+   block is initialized as by create_new_sector(). */
 static block_sector_t
 verify_sector (block_sector_t cur_sector, int index, bool
-    is_direct_level, bool create)
+    is_direct_level, bool create, block_sector_t owner, off_t pos,
+    off_t keep_end)
 {
   if (cur_sector == INODE_INVALID_BLOCK_SECTOR) 
     return INODE_INVALID_BLOCK_SECTOR;
@@ -142,35 +314,112 @@ verify_sector (block_sector_t cur_sector, int index, bool
   /* Allocate a new sector if necessary*/
   if (next_sector == INODE_INVALID_BLOCK_SECTOR && create) {
     enum sector_type type = is_direct_level ? REGULAR : METADATA;
-    next_sector = create_new_sector (cur_sector, index, type);
+    next_sector = create_new_sector (cur_sector, index, type, owner, pos,
+                                     keep_end);
   }
   
   return next_sector;
 }
 
+/* Stores SECTOR at index in CUR_SECTOR, an index block of the
+   inode at OWNER, and returns it. */
+static block_sector_t
+install_sector (block_sector_t cur_sector, int index, block_sector_t sector,
+    block_sector_t owner)
+{
+  if (cur_sector == INODE_INVALID_BLOCK_SECTOR)
+    return INODE_INVALID_BLOCK_SECTOR;
+
+  int bytes_written = buffercache_write (cur_sector, METADATA, owner,
+      index_to_offset (index), sizeof (block_sector_t), &sector);
+  if (bytes_written != sizeof (block_sector_t))
+    return INODE_INVALID_BLOCK_SECTOR;
+
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS. If CREATE is set, a missing block is allocated; the bytes
+   from POS up to KEEP_END are about to be written by the caller and
+   are not zeroed. */
 static block_sector_t
-byte_to_sector (struct inode *root, off_t pos, bool create) 
+byte_to_sector (struct inode *root, off_t pos, bool create, off_t keep_end)
 {
   ASSERT (root != NULL);
 
-  bool lock_held = lock_held_by_current_thread (&root->lock);
-  if (!lock_held)
-	lock_acquire (&root->lock);
+  /* Blocks never move once allocated, so a cached run is good
+     until the inode is closed, without taking the inode lock */
+  block_sector_t result = map_lookup (root, pos / BLOCK_SECTOR_SIZE);
+  if (result != INODE_INVALID_BLOCK_SECTOR)
+    return result;
+
+  bool lock_held = rwlock_held_by_current_thread (&root->lock);
+  if (lock_held)
+    return locked_byte_to_sector (root, pos, create, keep_end);
+
+  /* Look the block up alongside other readers, and only lock out
+     everyone else if it has to be allocated */
+  rwlock_acquire_read (&root->lock);
+  result = locked_byte_to_sector (root, pos, false, keep_end);
+  rwlock_release_read (&root->lock);
+
+  if (result == INODE_INVALID_BLOCK_SECTOR && create)
+  {
+    rwlock_acquire_write (&root->lock);
+    result = locked_byte_to_sector (root, pos, true, keep_end);
+    rwlock_release_write (&root->lock);
+  }
+
+  return result;
+}
 
+/* byte_to_sector() with the inode lock held: for writing if CREATE
+   is set, otherwise at least for reading. */
+static block_sector_t
+locked_byte_to_sector (struct inode *root, off_t pos, bool create,
+                       off_t keep_end)
+{
+  block_sector_t result = INODE_INVALID_BLOCK_SECTOR;
+
+  /* Holes within the file are only allocated when written to */
+  if (root->format == INODE_EXTENTS)
+    result = extent_byte_to_sector (root, pos, create);
+
+  /* Not an else: growing an extent inode may have converted it */
+  if (result == INODE_INVALID_BLOCK_SECTOR && root->format == INODE_RADIX)
+  {
+    result = radix_byte_to_sector (root, pos, create, keep_end,
+        INODE_INVALID_BLOCK_SECTOR);
+    if (result != INODE_INVALID_BLOCK_SECTOR)
+      map_insert (root, pos / BLOCK_SECTOR_SIZE, result, 1);
+  }
+
+  /* Inodes written before the other formats existed */
+  if (result == INODE_INVALID_BLOCK_SECTOR && root->format == INODE_INDIRECT)
+  {
+    result = indirect_byte_to_sector (root, pos, create, keep_end,
+        INODE_INVALID_BLOCK_SECTOR);
+    if (result != INODE_INVALID_BLOCK_SECTOR)
+      map_insert (root, pos / BLOCK_SECTOR_SIZE, result, 1);
+  }
+
+  return result;
+}
+
+/* byte_to_sector() for INODE_INDIRECT inodes. If LEAF is a valid
+   sector, it is installed as the data block for POS instead of a
+   newly allocated one. The inode lock must be held. */
+static block_sector_t
+indirect_byte_to_sector (struct inode *root, off_t pos, bool create_final,
+    off_t keep_end, block_sector_t leaf)
+{
   block_sector_t indirect_sector = root->disk_block;
   block_sector_t dubindirect_sector = INODE_INVALID_BLOCK_SECTOR;
   block_sector_t result = INODE_INVALID_BLOCK_SECTOR;
   off_t cur_pos = pos;
 
-  /* If we did not get a sector index, but we are still within
-     the length of the file, we can create a new block */
-  bool within_length = pos < root->length;
-  bool create_final = create || within_length;
-
   /* Move down from the doubly indirect level if needed */
   if (cur_pos >= INODE_DUBINDER_OFFSET)
   {
@@ -180,7 +429,8 @@ byte_to_sector (struct inode *root, off_t pos, bool create)
 
     cur_pos %= INODE_DUBINDER_SIZE;
     dubindirect_sector = verify_sector (root->disk_block,
-        dubinder_index, false, create_final);
+        dubinder_index, false, create_final, root->disk_block, pos,
+        keep_end);
   }
 
   /* Move down from the singly indirect level if needed the first 
@@ -204,22 +454,754 @@ byte_to_sector (struct inode *root, off_t pos, bool create)
   {
     cur_pos %= INODE_INDIRECT_SIZE;
     indirect_sector = verify_sector (dubindirect_sector, indir_index,
-        false, create_final); 
+        false, create_final, root->disk_block, pos, keep_end);
   }
 
   /* Find final block */
   if (cur_pos < INODE_DIRECT_SIZE) 
   {
     int direct_index = cur_pos/BLOCK_SECTOR_SIZE;
-    result = verify_sector (indirect_sector, direct_index,
-        true, create_final); 
+    if (leaf != INODE_INVALID_BLOCK_SECTOR)
+      result = install_sector (indirect_sector, direct_index, leaf,
+          root->disk_block);
+    else
+      result = verify_sector (indirect_sector, direct_index,
+          true, create_final, root->disk_block, pos, keep_end);
   }
-  if (!lock_held)
-	lock_release (&root->lock);
 
   return result;
 }
 
+/* byte_to_sector() for INODE_EXTENTS inodes. Blocks past the end
+   of the extents or in a hole are allocated if CREATE is set. The
+   inode lock must be held. */
+static block_sector_t
+extent_byte_to_sector (struct inode *root, off_t pos, bool create)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t result = extent_lookup (root, idx);
+
+  if (result == INODE_INVALID_BLOCK_SECTOR && create)
+  {
+    extent_grow (root, idx, idx + 1, false);
+    if (root->format == INODE_EXTENTS)
+      result = extent_lookup (root, idx);
+  }
+  return result;
+}
+
+/* Returns the sector holding file block IDX of extent inode ROOT,
+   or INODE_INVALID_BLOCK_SECTOR if its extents do not reach that
+   far or IDX is in a hole. Extents are read one at a time, so a
+   block near the start of the file costs few reads, and the extent
+   found is cached. */
+static block_sector_t
+extent_lookup (struct inode *root, size_t idx)
+{
+  struct inode_extent e;
+  uint32_t cnt, i;
+  size_t base = 0;
+
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, extents.cnt),
+                    sizeof cnt, &cnt);
+  for (i = 0; i < cnt && i < INODE_NUM_EXTENTS; i++)
+  {
+    buffercache_read (root->disk_block, METADATA,
+                      offsetof (struct inode_disk, extents.e[i]),
+                      sizeof e, &e);
+    if (idx < base + e.count)
+    {
+      if (e.start == INODE_INVALID_BLOCK_SECTOR)
+        return INODE_INVALID_BLOCK_SECTOR;
+      map_insert (root, base, e.start, e.count);
+      return e.start + (idx - base);
+    }
+    base += e.count;
+  }
+  return INODE_INVALID_BLOCK_SECTOR;
+}
+
+/* Makes room for an extent at I in T by moving the extents from I
+   on up by one, leaving a copy of extent I in its place. Returns
+   false if T is full. */
+static bool
+extent_insert (struct inode_extent_table *t, uint32_t i)
+{
+  if (t->cnt == INODE_NUM_EXTENTS) return false;
+  memmove (&t->e[i + 1], &t->e[i], (t->cnt - i) * sizeof t->e[i]);
+  t->cnt++;
+  return true;
+}
+
+/* Allocates file blocks LO through HI - 1 of T, which lie in the
+   hole that extent I covers from file block BASE on. Blocks are
+   taken after the run before the hole if they are free, otherwise
+   as new runs that split the hole. New blocks below the initialized
+   mark are zeroed, as the inode at OWNER would otherwise read them
+   as data. Returns false if the disk or T fills up first. */
+static bool
+extent_fill (struct inode_extent_table *t, uint32_t i, size_t base,
+             size_t lo, size_t hi, block_sector_t owner)
+{
+  struct inode_extent *prev;
+  block_sector_t start, near;
+  size_t got;
+
+  /* Split off the part of the hole before LO */
+  if (lo > base)
+  {
+    if (!extent_insert (t, i)) return false;
+    t->e[i].count = lo - base;
+    t->e[i + 1].count -= lo - base;
+    i++;
+  }
+
+  while (lo < hi)
+  {
+    prev = i > 0 ? &t->e[i - 1] : NULL;
+    got = 0;
+    if (prev != NULL && prev->start != INODE_INVALID_BLOCK_SECTOR)
+    {
+      /* Grow the run before the hole in place */
+      start = prev->start + prev->count;
+      got = free_map_allocate_at (start, hi - lo);
+      prev->count += got;
+      t->e[i].count -= got;
+      if (t->e[i].count == 0)
+      {
+        memmove (&t->e[i], &t->e[i + 1], (t->cnt - i - 1) * sizeof t->e[i]);
+        t->cnt--;
+      }
+    }
+    if (got == 0)
+    {
+      /* Put a new run in front of what is left of the hole, near
+         the run before it or else the inode */
+      near = prev != NULL && prev->start != INODE_INVALID_BLOCK_SECTOR
+             ? prev->start + prev->count : owner;
+      for (got = hi - lo;
+           got > 0 && !free_map_allocate_near (got, near, &start);
+           got /= 2)
+        continue;
+      if (got == 0) return false;
+      if (got < t->e[i].count)
+      {
+        if (!extent_insert (t, i))
+        {
+          free_map_release (start, got);
+          return false;
+        }
+        t->e[i + 1].count -= got;
+      }
+      t->e[i].start = start;
+      t->e[i].count = got;
+      i++;
+    }
+
+    if (lo < t->initialized)
+      zero_sectors (start, lo + got < t->initialized ? got
+                    : t->initialized - lo, owner);
+    lo += got;
+  }
+  return true;
+}
+
+/* Makes the extents of D, the disk inode at OWNER, map file blocks
+   FIRST through SECTORS - 1 to sectors. Holes in that range are
+   filled and, if the extents end before FIRST, the blocks up to it
+   become a hole. Past the end, the last run is grown in place while
+   the sectors after it are free, and new runs are made as long as
+   the free map allows. Blocks added at the end are past the
+   initialized mark, so they are not zeroed. Returns false if the
+   disk or the extent table fills up first. */
+static bool
+extent_allocate (struct inode_disk *d, size_t first, size_t sectors,
+                 block_sector_t owner)
+{
+  struct inode_extent_table *t = &d->extents;
+  struct inode_extent *last;
+  block_sector_t start, near;
+  size_t mapped, need, got, base, end;
+  uint32_t i;
+
+  /* Fill the holes in the range. Filling rearranges the table, so
+     each time start over from the beginning */
+  for (i = 0, base = 0; i < t->cnt && base < sectors; )
+  {
+    end = base + t->e[i].count;
+    if (t->e[i].start == INODE_INVALID_BLOCK_SECTOR && end > first)
+    {
+      if (!extent_fill (t, i, base, base > first ? base : first,
+                        end < sectors ? end : sectors, owner))
+        return false;
+      i = 0;
+      base = 0;
+      continue;
+    }
+    base = end;
+    i++;
+  }
+
+  /* Leave a hole up to FIRST */
+  mapped = sectors_mapped (t);
+  if (mapped < first)
+  {
+    last = t->cnt > 0 ? &t->e[t->cnt - 1] : NULL;
+    if (last != NULL && last->start == INODE_INVALID_BLOCK_SECTOR)
+      last->count += first - mapped;
+    else
+    {
+      if (t->cnt == INODE_NUM_EXTENTS) return false;
+      t->e[t->cnt].start = INODE_INVALID_BLOCK_SECTOR;
+      t->e[t->cnt].count = first - mapped;
+      t->cnt++;
+    }
+    mapped = first;
+  }
+
+  while (mapped < sectors)
+  {
+    need = sectors - mapped;
+    got = 0;
+
+    /* Grow the last run in place */
+    last = t->cnt > 0 ? &t->e[t->cnt - 1] : NULL;
+    if (last != NULL && last->start != INODE_INVALID_BLOCK_SECTOR)
+    {
+      start = last->start + last->count;
+      got = free_map_allocate_at (start, need);
+      last->count += got;
+    }
+
+    /* Otherwise start a new run, as long a one as is free */
+    if (got == 0)
+    {
+      if (t->cnt == INODE_NUM_EXTENTS) return false;
+      near = last != NULL && last->start != INODE_INVALID_BLOCK_SECTOR
+             ? last->start + last->count : owner;
+      for (got = need;
+           got > 0 && !free_map_allocate_near (got, near, &start);
+           got /= 2)
+        continue;
+      if (got == 0) return false;
+      t->e[t->cnt].start = start;
+      t->e[t->cnt].count = got;
+      t->cnt++;
+    }
+
+    mapped += got;
+  }
+  return true;
+}
+
+/* Makes extent inode ROOT map file blocks FIRST through SECTORS - 1.
+   If AHEAD is set, the file is being appended to and up to as many
+   blocks again as it already has, but at most INODE_PREALLOC_MAX,
+   are allocated beyond that, so that a file written in small
+   appends still gets long runs; blocks past the end of the file
+   are given back when it is closed. If the extent table fills up
+   first, ROOT is converted to the radix format, which then
+   allocates the rest a block at a time. The inode lock must be
+   held. */
+static void
+extent_grow (struct inode *root, size_t first, size_t sectors, bool ahead)
+{
+  struct inode_disk *d = malloc (sizeof *d);
+  struct inode_extent_table *old = malloc (sizeof *old);
+  size_t extra;
+  bool success;
+
+  if (d == NULL || old == NULL)
+  {
+    free (d);
+    free (old);
+    return;
+  }
+  buffercache_read (root->disk_block, METADATA, 0, BLOCK_SECTOR_SIZE, d);
+  *old = d->extents;
+
+  success = extent_allocate (d, first, sectors, root->disk_block);
+  if (success && ahead)
+  {
+    extra = bytes_to_sectors (root->length);
+    if (extra > INODE_PREALLOC_MAX)
+      extra = INODE_PREALLOC_MAX;
+    extent_allocate (d, sectors, sectors + extra, root->disk_block);
+  }
+
+  /* Only write the table back if it changed */
+  if (memcmp (old, &d->extents, sizeof *old))
+    buffercache_write (root->disk_block, METADATA, root->disk_block,
+                       offsetof (struct inode_disk, extents),
+                       sizeof d->extents, &d->extents);
+
+  if (!success && d->extents.cnt == INODE_NUM_EXTENTS)
+    extent_to_radix (root, d);
+  free (old);
+  free (d);
+}
+
+/* Rewrites the block map of extent inode ROOT, read into D, in the
+   radix format. Holes stay holes. The inode lock must be held. */
+static void
+extent_to_radix (struct inode *root, struct inode_disk *d)
+{
+  struct inode_extent_table *t = malloc (sizeof *t);
+  size_t idx = 0;
+  uint32_t i, j;
+
+  if (t == NULL) return;
+  *t = d->extents;
+
+  /* The radix format has no initialized mark, so zero the blocks
+     allocated ahead of being written */
+  if (t->cnt > 0)
+    extent_initialize (root, sectors_mapped (t) - 1, 0, 0);
+
+  /* Switch the inode over with an empty block map */
+  d->radix.depth = 0;
+  memset (d->radix.root, INODE_INVALID_BLOCK_SECTOR, sizeof d->radix.root);
+  d->format = INODE_RADIX;
+  buffercache_write (root->disk_block, METADATA, root->disk_block, 0,
+                     sizeof d->radix, &d->radix);
+  buffercache_write (root->disk_block, METADATA, root->disk_block,
+                     offsetof (struct inode_disk, format),
+                     sizeof d->format, &d->format);
+  root->format = INODE_RADIX;
+  root->initialized = SIZE_MAX;
+  map_clear (root);
+
+  /* Enter every block the extents held */
+  for (i = 0; i < t->cnt; i++)
+  {
+    if (t->e[i].start == INODE_INVALID_BLOCK_SECTOR)
+    {
+      idx += t->e[i].count;
+      continue;
+    }
+    for (j = 0; j < t->e[i].count; j++, idx++)
+      radix_byte_to_sector (root, idx * BLOCK_SECTOR_SIZE, true, 0,
+                            t->e[i].start + j);
+  }
+  free (t);
+}
+
+/* Zeroes the allocated blocks of extent inode ROOT from its
+   initialized mark through block IDX and moves the mark past IDX,
+   or to the end of the extents if they end first. Called before a
+   write reaches IDX, so that neither the gap before it nor the rest
+   of a partly written block can show what the sectors held before.
+   The bytes from KEEP_OFS up to KEEP_END are about to be written by
+   the caller and are left alone. The inode lock must be held. */
+static void
+extent_initialize (struct inode *root, size_t idx, off_t keep_ofs,
+                   off_t keep_end)
+{
+  struct inode_extent_table *t = malloc (sizeof *t);
+  size_t base = 0, end, b;
+  uint32_t i, initialized;
+
+  if (t == NULL) return;
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, extents),
+                    sizeof *t, t);
+  for (i = 0; i < t->cnt && root->initialized <= idx; i++)
+  {
+    end = base + t->e[i].count;
+    if (end > idx + 1)
+      end = idx + 1;
+    if (end > root->initialized)
+    {
+      if (t->e[i].start != INODE_INVALID_BLOCK_SECTOR)
+        for (b = root->initialized > base ? root->initialized : base;
+             b < end; b++)
+          zero_sector_except (t->e[i].start + (b - base),
+                              (off_t) b * BLOCK_SECTOR_SIZE, keep_ofs,
+                              keep_end, root->disk_block);
+      root->initialized = end;
+    }
+    base += t->e[i].count;
+  }
+  free (t);
+
+  initialized = root->initialized;
+  buffercache_write (root->disk_block, METADATA, root->disk_block,
+                     offsetof (struct inode_disk, extents.initialized),
+                     sizeof initialized, &initialized);
+}
+
+/* Gives back the blocks of extent inode ROOT past the end of the
+   file, which were allocated ahead of appends that never came.
+   The inode lock must be held. */
+static void
+extent_trim (struct inode *root)
+{
+  struct inode_extent_table *t = malloc (sizeof *t);
+  struct inode_extent *e;
+  size_t keep = bytes_to_sectors (root->length);
+  size_t mapped, cut;
+
+  if (t == NULL) return;
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, extents),
+                    sizeof *t, t);
+  mapped = sectors_mapped (t);
+  if (mapped > keep)
+  {
+    while (mapped > keep)
+    {
+      e = &t->e[t->cnt - 1];
+      cut = mapped - e->count >= keep ? e->count : mapped - keep;
+      if (e->start != INODE_INVALID_BLOCK_SECTOR)
+        free_map_release (e->start + (e->count - cut), cut);
+      e->count -= cut;
+      mapped -= cut;
+      if (e->count == 0)
+        t->cnt--;
+    }
+    if (t->initialized > keep)
+      t->initialized = keep;
+    buffercache_write (root->disk_block, METADATA, root->disk_block,
+                       offsetof (struct inode_disk, extents),
+                       sizeof *t, t);
+
+    /* The inode may be reopened, so forget the blocks given back */
+    root->initialized = t->initialized;
+    map_clear (root);
+  }
+  free (t);
+}
+
+/* Frees the data sectors of extent inode ROOT. */
+static void
+extent_release (struct inode *root)
+{
+  struct inode_extent_table *t = malloc (sizeof *t);
+  uint32_t i;
+
+  if (t == NULL) return;
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, extents),
+                    sizeof *t, t);
+  for (i = 0; i < t->cnt; i++)
+    if (t->e[i].start != INODE_INVALID_BLOCK_SECTOR)
+      free_map_release (t->e[i].start, t->e[i].count);
+  free (t);
+}
+
+/* Moves the data of inline inode ROOT out to a block and switches it
+   to the extent format, so that it can grow past INODE_INLINE_SIZE.
+   Returns false if out of memory or disk space. The inode lock must
+   be held. */
+static bool
+inline_to_extents (struct inode *root)
+{
+  struct inode_disk *d = malloc (sizeof *d);
+  uint8_t *data = calloc (1, BLOCK_SECTOR_SIZE);
+  bool success = false;
+
+  if (d == NULL || data == NULL)
+    goto done;
+  buffercache_read (root->disk_block, METADATA, 0, BLOCK_SECTOR_SIZE, d);
+  memcpy (data, d->data, sizeof d->data);
+
+  memset (&d->extents, 0, sizeof d->extents);
+  if (root->length > 0)
+  {
+    if (!extent_allocate (d, 0, 1, root->disk_block))
+      goto done;
+    buffercache_write (d->extents.e[0].start, REGULAR, root->disk_block, 0,
+                       BLOCK_SECTOR_SIZE, data);
+    d->extents.initialized = 1;
+  }
+
+  d->format = INODE_EXTENTS;
+  buffercache_write (root->disk_block, METADATA, root->disk_block, 0,
+                     sizeof d->extents, &d->extents);
+  buffercache_write (root->disk_block, METADATA, root->disk_block,
+                     offsetof (struct inode_disk, format),
+                     sizeof d->format, &d->format);
+  root->format = INODE_EXTENTS;
+  root->initialized = d->extents.initialized;
+  map_clear (root);
+  success = true;
+
+ done:
+  free (data);
+  free (d);
+  return success;
+}
+
+/* Returns the number of file blocks that one root pointer of a
+   radix tree DEPTH levels deep maps. */
+static size_t
+radix_span (uint32_t depth)
+{
+  size_t span = 1;
+
+  while (depth-- > 0)
+    span *= INODE_RADIX_FANOUT;
+  return span;
+}
+
+/* Makes the radix tree of ROOT, which is DEPTH levels deep, one
+   level deeper by moving its root pointers into a new index block.
+   Returns false if the disk is full. The inode lock must be held. */
+static bool
+radix_deepen (struct inode *root, uint32_t depth)
+{
+  struct inode_radix *r = malloc (sizeof *r);
+  block_sector_t *index = malloc (BLOCK_SECTOR_SIZE);
+  block_sector_t sector;
+  bool success = false;
+
+  if (r == NULL || index == NULL || !free_map_allocate_near (1, root->disk_block, &sector))
+    goto done;
+
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, radix), sizeof *r, r);
+  memset (index, INODE_INVALID_BLOCK_SECTOR, BLOCK_SECTOR_SIZE);
+  memcpy (index, r->root, sizeof r->root);
+  buffercache_write (sector, METADATA, root->disk_block, 0,
+                     BLOCK_SECTOR_SIZE, index);
+
+  r->depth = depth + 1;
+  memset (r->root, INODE_INVALID_BLOCK_SECTOR, sizeof r->root);
+  r->root[0] = sector;
+  buffercache_write (root->disk_block, METADATA, root->disk_block,
+                     offsetof (struct inode_disk, radix), sizeof *r, r);
+  success = true;
+
+ done:
+  free (index);
+  free (r);
+  return success;
+}
+
+/* byte_to_sector() for INODE_RADIX inodes. Missing index and data
+   blocks are allocated, and the tree deepened, if CREATE is set. If
+   LEAF is a valid sector, it is installed as the data block for POS
+   instead of a newly allocated one. The inode lock must be held. */
+static block_sector_t
+radix_byte_to_sector (struct inode *root, off_t pos, bool create,
+                      off_t keep_end, block_sector_t leaf)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t cur = root->disk_block;
+  uint32_t depth;
+  size_t span;
+  int index;
+
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, radix.depth),
+                    sizeof depth, &depth);
+  while (idx / radix_span (depth) >= INODE_RADIX_ROOT)
+  {
+    if (!create || !radix_deepen (root, depth))
+      return INODE_INVALID_BLOCK_SECTOR;
+    depth++;
+  }
+
+  /* The root pointers follow the depth in the inode sector, which
+     puts root pointer I at index I + 1 */
+  span = radix_span (depth);
+  index = 1 + idx / span;
+  idx %= span;
+  while (span > 1)
+  {
+    cur = verify_sector (cur, index, false, create, root->disk_block, pos,
+                         keep_end);
+    span /= INODE_RADIX_FANOUT;
+    index = idx / span;
+    idx %= span;
+  }
+
+  if (leaf != INODE_INVALID_BLOCK_SECTOR)
+    return install_sector (cur, index, leaf, root->disk_block);
+  return verify_sector (cur, index, true, create, root->disk_block, pos,
+                        keep_end);
+}
+
+/* Frees SECTOR, the root of a subtree LEVEL levels of index blocks
+   deep, and every block under it. */
+static void
+radix_free (block_sector_t sector, uint32_t level)
+{
+  block_sector_t *index;
+  size_t i;
+
+  if (level > 0 && (index = malloc (BLOCK_SECTOR_SIZE)) != NULL)
+  {
+    buffercache_read (sector, METADATA, 0, BLOCK_SECTOR_SIZE, index);
+    for (i = 0; i < INODE_RADIX_FANOUT; i++)
+      if (index[i] != INODE_INVALID_BLOCK_SECTOR)
+        radix_free (index[i], level - 1);
+    free (index);
+  }
+  free_map_release (sector, 1);
+}
+
+/* Frees the index and data blocks of radix inode ROOT. */
+static void
+radix_release (struct inode *root)
+{
+  struct inode_radix *r = malloc (sizeof *r);
+  int i;
+
+  if (r == NULL) return;
+  buffercache_read (root->disk_block, METADATA,
+                    offsetof (struct inode_disk, radix), sizeof *r, r);
+  for (i = 0; i < INODE_RADIX_ROOT; i++)
+    if (r->root[i] != INODE_INVALID_BLOCK_SECTOR)
+      radix_free (r->root[i], r->depth);
+  free (r);
+}
+
+/* Returns the sector holding file block IDX of ROOT if it is in
+   one of ROOT's cached runs, INODE_INVALID_BLOCK_SECTOR otherwise.
+   Readers do not take MAP_LOCK: they read MAP between two reads of
+   MAP_SEQ and try again if a change got in between. Only if one is
+   in progress do they wait for it on the lock. */
+static block_sector_t
+map_lookup (struct inode *root, size_t idx)
+{
+  block_sector_t result;
+  struct inode_map *m;
+  unsigned seq;
+
+  for (;;)
+  {
+    seq = *(volatile unsigned *) &root->map_seq;
+    if (seq % 2 != 0)
+    {
+      lock_acquire (&root->map_lock);
+      lock_release (&root->map_lock);
+      continue;
+    }
+    barrier ();
+
+    result = INODE_INVALID_BLOCK_SECTOR;
+    for (m = root->map; m < root->map + INODE_MAP_CACHE_SIZE; m++)
+      if (idx >= m->base && idx < m->base + m->count)
+      {
+        result = m->start + (idx - m->base);
+        break;
+      }
+
+    barrier ();
+    if (*(volatile unsigned *) &root->map_seq == seq)
+      return result;
+  }
+}
+
+/* Starts and ends a change to ROOT's cached runs, which must be
+   made with MAP_LOCK held. */
+static void
+map_change_begin (struct inode *root)
+{
+  ASSERT (lock_held_by_current_thread (&root->map_lock));
+  root->map_seq++;
+  barrier ();
+}
+
+static void
+map_change_end (struct inode *root)
+{
+  barrier ();
+  root->map_seq++;
+}
+
+/* Caches the run of COUNT file blocks of ROOT starting at block
+   BASE, held in the sectors starting at START. A run that it
+   continues or overlaps, such as a single block just before it in
+   a contiguous file or an earlier, shorter copy of the same
+   extent, is extended instead of taking another slot. */
+static void
+map_insert (struct inode *root, size_t base, block_sector_t start,
+            size_t count)
+{
+  struct inode_map *m;
+
+  lock_acquire (&root->map_lock);
+  for (m = root->map; m < root->map + INODE_MAP_CACHE_SIZE; m++)
+    if (m->count > 0 && m->base <= base && base <= m->base + m->count
+        && m->start - m->base == start - base)
+    {
+      if (base + count > m->base + m->count)
+      {
+        map_change_begin (root);
+        m->count = base + count - m->base;
+        map_change_end (root);
+      }
+      lock_release (&root->map_lock);
+      return;
+    }
+
+  map_change_begin (root);
+  m = &root->map[root->map_next];
+  root->map_next = (root->map_next + 1) % INODE_MAP_CACHE_SIZE;
+  m->base = base;
+  m->start = start;
+  m->count = count;
+  map_change_end (root);
+  lock_release (&root->map_lock);
+}
+
+/* Forgets all of ROOT's cached runs. */
+static void
+map_clear (struct inode *root)
+{
+  int i;
+
+  lock_acquire (&root->map_lock);
+  map_change_begin (root);
+  for (i = 0; i < INODE_MAP_CACHE_SIZE; i++)
+    root->map[i].count = 0;
+  root->map_next = 0;
+  map_change_end (root);
+  lock_release (&root->map_lock);
+}
+
+/* Fills CNT sectors starting at SECTOR, which were just allocated
+   to the inode at OWNER, with zeros. */
+static void
+zero_sectors (block_sector_t sector, size_t cnt, block_sector_t owner)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    buffercache_write (sector + i, REGULAR, owner, 0, BLOCK_SECTOR_SIZE,
+                       zeros);
+}
+
+/* Fills SECTOR, which holds the file bytes from POS on, with zeros,
+   except for the bytes from KEEP_OFS up to KEEP_END. */
+static void
+zero_sector_except (block_sector_t sector, off_t pos, off_t keep_ofs,
+                    off_t keep_end, block_sector_t owner)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  off_t lo = keep_ofs - pos;
+  off_t hi = keep_end - pos;
+
+  if (lo < 0)
+    lo = 0;
+  if (hi > BLOCK_SECTOR_SIZE)
+    hi = BLOCK_SECTOR_SIZE;
+  if (lo >= hi)
+  {
+    zero_sectors (sector, 1, owner);
+    return;
+  }
+  if (lo > 0)
+    buffercache_write (sector, REGULAR, owner, 0, lo, zeros);
+  if (hi < BLOCK_SECTOR_SIZE)
+    buffercache_write (sector, REGULAR, owner, hi, BLOCK_SECTOR_SIZE - hi,
+                       zeros);
+}
+
 typedef void (*inode_sector_map_fn) (block_sector_t sector, bool meta);
 
 
@@ -306,11 +1288,31 @@ inode_sector_map (struct inode *root, inode_sector_map_fn map_fn)
 }
   
 
+/* Hashes an open inode by its sector. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->disk_block);
+}
+
+/* Orders open inodes by sector. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return hash_entry (a, struct inode, elem)->disk_block
+         < hash_entry (b, struct inode, elem)->disk_block;
+}
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table creation failed");
+  list_init (&closed_inodes);
+  lock_init (&open_inodes_lock);
+  cond_init (&inodes_settled);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -333,13 +1335,41 @@ inode_create (block_sector_t sector, off_t length, const bool directory)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
   {
-    memset(disk_inode, INODE_INVALID_BLOCK_SECTOR, INODE_NUM_BLOCKS * sizeof(block_sector_t));
+    /* Small files keep their data in the inode. Others map their
+       blocks with extents, allocated as contiguously as possible up
+       front. Blocks that do not fit in the extent table are allocated
+       when first accessed, but if the disk runs out the inode is not
+       created. None are initialized, so they read as zeros without
+       being written. */
+    success = true;
+    if (length <= (off_t) INODE_INLINE_SIZE)
+      disk_inode->format = INODE_INLINE;
+    else
+    {
+      disk_inode->format = INODE_EXTENTS;
+      disk_inode->extents.cnt = 0;
+      disk_inode->extents.initialized = 0;
+      if (!extent_allocate (disk_inode, 0, bytes_to_sectors (length),
+                            sector))
+        success = disk_inode->extents.cnt == INODE_NUM_EXTENTS;
+    }
     disk_inode->length = length;
     disk_inode->directory = directory;
     disk_inode->magic = INODE_MAGIC;
-    int wrote = buffercache_write (sector, METADATA, 0, BLOCK_SECTOR_SIZE,
-                                   disk_inode, INODE_INVALID_BLOCK_SECTOR);
-    success = (wrote == BLOCK_SECTOR_SIZE);
+    if (success)
+    {
+      int wrote = buffercache_write (sector, METADATA, sector, 0,
+                                     BLOCK_SECTOR_SIZE, disk_inode);
+      success = (wrote == BLOCK_SECTOR_SIZE);
+    }
+    if (!success && disk_inode->format == INODE_EXTENTS)
+    {
+      uint32_t i;
+      for (i = 0; i < disk_inode->extents.cnt; i++)
+        if (disk_inode->extents.e[i].start != INODE_INVALID_BLOCK_SECTOR)
+          free_map_release (disk_inode->extents.e[i].start,
+                          disk_inode->extents.e[i].count);
+    }
     free (disk_inode);
   }
   return success;
@@ -351,44 +1381,86 @@ inode_create (block_sector_t sector, off_t length, const bool directory)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct hash_elem *e;
   struct inode *inode;
+  struct inode key;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open, waiting for it if
+     another thread is reading it in or closing it. */
+  lock_acquire (&open_inodes_lock);
+  key.disk_block = sector;
+  while ((e = hash_find (&open_inodes, &key.elem)) != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->disk_block == sector) 
+      inode = hash_entry (e, struct inode, elem);
+      if (inode->busy)
         {
-          inode_reopen (inode);
-          return inode; 
+          cond_wait (&inodes_settled, &open_inodes_lock);
+          continue;
         }
+      if (inode->open_cnt++ == 0)
+        {
+          list_remove (&inode->closed_elem);
+          closed_cnt--;
+        }
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
-  /* Allocate memory. */
+  /* Allocate memory, dropping closed inodes if there is none. */
   inode = malloc (sizeof *inode);
+  while (inode == NULL && inode_reclaim ())
+    inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize, keeping other openers away until it is read in. */
   inode->disk_block = sector;
+  inode->open_cnt = 1;
+  inode->busy = true;
+  inode->deny_write_cnt = 0;
+  inode->deny_remove_cnt = 0;
+  inode->removed = false;
+  rwlock_init (&inode->lock);
+  rwlock_init (&inode->dir_lock);
+  lock_init (&inode->map_lock);
+  inode->map_seq = 0;
+  map_clear (inode);
+  hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
   /* Read length and directory flag from block */
   int read = buffercache_read (sector, METADATA,
                                offsetof (struct inode_disk, length),
                                sizeof (off_t) + sizeof (bool),
-                               &inode->length,
-                               INODE_INVALID_BLOCK_SECTOR);
+                               &inode->length);
   if (read != (sizeof (off_t) + sizeof (bool)))
   {
+    lock_acquire (&open_inodes_lock);
+    hash_delete (&open_inodes, &inode->elem);
+    cond_broadcast (&inodes_settled, &open_inodes_lock);
+    lock_release (&open_inodes_lock);
     free(inode);
     return NULL;
   }
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  lock_init (&inode->lock);
+  buffercache_read (sector, METADATA, offsetof (struct inode_disk, format),
+                    sizeof inode->format, &inode->format);
+  inode->initialized = SIZE_MAX;
+  if (inode->format == INODE_EXTENTS)
+  {
+    uint32_t initialized;
+    buffercache_read (sector, METADATA,
+                      offsetof (struct inode_disk, extents.initialized),
+                      sizeof initialized, &initialized);
+    inode->initialized = initialized;
+  }
+
+  lock_acquire (&open_inodes_lock);
+  inode->busy = false;
+  cond_broadcast (&inodes_settled, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -402,10 +1474,12 @@ void inode_sector_free_map_fn (block_sector_t sector, bool meta UNUSED)
 struct inode *
 inode_reopen (struct inode *inode)
 {
-  lock_acquire (&inode->lock);
   if (inode != NULL)
+  {
+    lock_acquire (&open_inodes_lock);
     inode->open_cnt++;
-  lock_release (&inode->lock);
+    lock_release (&open_inodes_lock);
+  }
   return inode;
 }
 
@@ -417,8 +1491,10 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, it is kept in the table
+   of closed inodes, and the least recently closed one is freed if
+   there are too many. If INODE was also a removed inode, frees its
+   blocks and its memory right away. */
 void
 inode_close (struct inode *inode) 
 {
@@ -426,28 +1502,95 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  lock_acquire (&inode->lock);
-  inode->open_cnt--;
-  lock_release (&inode->lock);
-  /* Release resources if this was the last opener. */
-  if (inode->open_cnt == 0)
+  /* On the last close, a removed inode leaves the table at once.
+     Any other is marked busy while it is written out, which keeps
+     inode_open() from handing it out again until it is on the
+     closed inodes. No one else can reach INODE in between, so it
+     is not locked itself. */
+  lock_acquire (&open_inodes_lock);
+  int open_cnt = --inode->open_cnt;
+  if (open_cnt == 0 && inode->removed)
+    hash_delete (&open_inodes, &inode->elem);
+  else if (open_cnt == 0)
+    inode->busy = true;
+  lock_release (&open_inodes_lock);
+
+  if (open_cnt == 0 && !inode->removed)
   {
-    /* Remove from inode list and release lock. */
-    list_remove (&inode->elem);
+    if (inode->format == INODE_EXTENTS)
+      extent_trim (inode);
+    inode_write_length (inode);
+
+    lock_acquire (&open_inodes_lock);
+    inode->busy = false;
+    list_push_back (&closed_inodes, &inode->closed_elem);
+    if (++closed_cnt > INODE_CACHE_SIZE)
+      inode_reclaim ();
+    cond_broadcast (&inodes_settled, &open_inodes_lock);
+    lock_release (&open_inodes_lock);
+  }
 
-    /* Deallocate blocks if removed. */
-    if (inode->removed) 
+  /* Deallocate blocks if removed. */
+  if (open_cnt == 0 && inode->removed)
+  {
+    if (inode->format == INODE_EXTENTS)
     {
+      extent_release (inode);
+      free_map_release (inode->disk_block, 1);
+    } else if (inode->format == INODE_RADIX) {
+      radix_release (inode);
+      free_map_release (inode->disk_block, 1);
+    } else if (inode->format == INODE_INLINE) {
+      free_map_release (inode->disk_block, 1);
+    } else {
       inode_sector_map (inode, inode_sector_free_map_fn);
     }
-    buffercache_write (inode->disk_block, METADATA,
-                       offsetof (struct inode_disk, length), sizeof (off_t) +
-                       sizeof (bool), &inode->length,
-                       INODE_INVALID_BLOCK_SECTOR);
     free (inode); 
   }
 }
 
+/* Frees the least recently closed inode that is still cached.
+   Returns false if there is none. The table lock must be held. */
+static bool
+inode_reclaim (void)
+{
+  struct inode *victim;
+
+  if (list_empty (&closed_inodes))
+    return false;
+  victim = list_entry (list_pop_front (&closed_inodes), struct inode,
+                       closed_elem);
+  hash_delete (&open_inodes, &victim->elem);
+  closed_cnt--;
+  free (victim);
+  return true;
+}
+
+/* Writes INODE's length and directory flag, which are only kept in
+   memory while it is open, to its disk inode. */
+static void
+inode_write_length (struct inode *inode)
+{
+  buffercache_write (inode->disk_block, METADATA, inode->disk_block,
+                     offsetof (struct inode_disk, length), sizeof (off_t) +
+                     sizeof (bool), &inode->length);
+}
+
+/* Writes INODE's data and metadata that are still only in the
+   buffer cache to disk, without flushing other files. */
+void
+inode_sync (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->lock);
+  inode_write_length (inode);
+  rwlock_release_write (&inode->lock);
+
+  /* Blocks the inode points to must be marked in use on disk
+     before it does */
+  free_map_sync ();
+  buffercache_sync (inode->disk_block);
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 bool
@@ -468,12 +1611,30 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
 
+  /* An inline file is read straight out of its inode */
+  if (inode->format == INODE_INLINE)
+  {
+    bool lock_held = rwlock_held_by_current_thread (&inode->lock);
+    if (!lock_held)
+      rwlock_acquire_read (&inode->lock);
+    if (inode->format == INODE_INLINE)
+    {
+      if (size > inode->length - offset)
+        size = inode->length - offset;
+      if (size > 0)
+        bytes_read = buffercache_read (inode->disk_block, METADATA,
+                                       offsetof (struct inode_disk, data)
+                                       + offset, size, buffer);
+      size = 0;
+    }
+    if (!lock_held)
+      rwlock_release_read (&inode->lock);
+  }
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset, false);
-      if (sector_idx == INODE_INVALID_BLOCK_SECTOR) break;
-
+      block_sector_t sector_idx = byte_to_sector (inode, offset, false, 0);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -486,11 +1647,15 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      /* Read chunk from this sector */
-      int read = buffercache_read (sector_idx, REGULAR, sector_ofs,
-                                   chunk_size, buffer + bytes_read,
-                                   byte_to_sector (inode, offset+chunk_size,
-                                                   false));
+      /* Read chunk from this sector. Holes and blocks that were
+         allocated but never written hold zeros. */
+      int read = chunk_size;
+      if (sector_idx == INODE_INVALID_BLOCK_SECTOR
+          || (size_t) offset / BLOCK_SECTOR_SIZE >= inode->initialized)
+        memset (buffer + bytes_read, 0, chunk_size);
+      else
+        read = buffercache_read (sector_idx, REGULAR, sector_ofs,
+                                 chunk_size, buffer + bytes_read);
       /* Advance. */
       size -= read;
       offset += read;
@@ -501,11 +1666,28 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Returns true if the SIZE bytes of INODE at OFFSET are held in
+   blocks that are in INODE's cached runs and have been written
+   before, so that writing them changes nothing but their data. */
+static bool
+write_is_mapped (struct inode *inode, off_t size, off_t offset)
+{
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  size_t last = bytes_to_sectors (offset + size) - 1;
+
+  if (inode->format == INODE_INLINE || last >= inode->initialized)
+    return false;
+  for (; idx <= last; idx++)
+    if (map_lookup (inode, idx) == INODE_INVALID_BLOCK_SECTOR)
+      return false;
+  return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or an error occurs. A write
+   past end of file extends the inode, allocating blocks as
+   needed. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -516,10 +1698,55 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   if (inode->deny_write_cnt)
     return 0;
 
+  /* Allocate all the blocks the write needs at once, so that they
+     can be contiguous, with more ahead of them if it appends. Then
+     zero what the write leaves uninitialized before it. An overwrite
+     of blocks that are already mapped and initialized needs neither,
+     and does not lock out readers. */
+  if (size > 0 && !write_is_mapped (inode, size, offset))
+  {
+    bool lock_held = rwlock_held_by_current_thread (&inode->lock);
+    if (!lock_held)
+      rwlock_acquire_write (&inode->lock);
+
+    /* A write that still fits in an inline inode goes to the inode
+       sector, a larger one moves the data out first */
+    if (inode->format == INODE_INLINE)
+    {
+      if (offset + size <= (off_t) INODE_INLINE_SIZE)
+      {
+        bytes_written = buffercache_write (inode->disk_block, METADATA,
+                                           inode->disk_block,
+                                           offsetof (struct inode_disk, data)
+                                           + offset, size, buffer);
+        if (offset + bytes_written > inode->length)
+          inode->length = offset + bytes_written;
+        size = 0;
+      }
+      else if (!inline_to_extents (inode))
+        size = 0;
+    }
+
+    size_t first = offset / BLOCK_SECTOR_SIZE;
+    size_t last = bytes_to_sectors (offset + size) - 1;
+    size_t idx = first;
+    while (size > 0 && idx <= last
+           && map_lookup (inode, idx) != INODE_INVALID_BLOCK_SECTOR)
+      idx++;
+    if (size > 0 && inode->format == INODE_EXTENTS && idx <= last)
+      extent_grow (inode, first, last + 1, offset + size > inode->length);
+    if (size > 0 && inode->format == INODE_EXTENTS
+        && last >= inode->initialized)
+      extent_initialize (inode, last, offset, offset + size);
+    if (!lock_held)
+      rwlock_release_write (&inode->lock);
+  }
+
   while (size > 0) 
   {
     /* Sector to write, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector (inode, offset, true);
+    block_sector_t sector_idx = byte_to_sector (inode, offset, true,
+                                                offset + size);
     if (sector_idx == INODE_INVALID_BLOCK_SECTOR) break;
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
@@ -532,10 +1759,8 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       break;
 
     /* Write chunk to this sector. */
-    int wrote = buffercache_write (sector_idx, REGULAR, sector_ofs,
-        chunk_size, buffer + bytes_written,
-        byte_to_sector (inode, offset+chunk_size,
-          false));
+    int wrote = buffercache_write (sector_idx, REGULAR, inode->disk_block,
+        sector_ofs, chunk_size, buffer + bytes_written);
     /* Advance. */
     size -= wrote;
     offset += wrote;
@@ -544,25 +1769,88 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   }
 
   /* Handle file extension */
-  bool lock_held = lock_held_by_current_thread (&inode->lock);
-  if (!lock_held)
-	lock_acquire (&inode->lock);
-  if (offset + bytes_written > inode->length) inode->length = offset;
-  if (!lock_held)
-	lock_release (&inode->lock);
+  if (offset > inode->length)
+  {
+    bool lock_held = rwlock_held_by_current_thread (&inode->lock);
+    if (!lock_held)
+      rwlock_acquire_write (&inode->lock);
+    if (offset > inode->length) inode->length = offset;
+    if (!lock_held)
+      rwlock_release_write (&inode->lock);
+  }
 
   return bytes_written;
 }
 
+/* Allocates the blocks of INODE's first LENGTH bytes, extending
+   INODE to LENGTH bytes if it is shorter. An extent inode gets
+   them in as few runs as the free map allows and does not write
+   them until they are written to; they read as zeros. Returns true
+   if successful, false if the disk is full. */
+bool
+inode_allocate (struct inode *inode, off_t length)
+{
+  size_t sectors;
+  bool success = true;
+  off_t pos;
+
+  ASSERT (length >= 0);
+  sectors = bytes_to_sectors (length);
+
+  rwlock_acquire_write (&inode->lock);
+  if (inode->deny_write_cnt)
+  {
+    rwlock_release_write (&inode->lock);
+    return false;
+  }
+  if (inode->format == INODE_INLINE && length > (off_t) INODE_INLINE_SIZE)
+    success = inline_to_extents (inode);
+  if (inode->format == INODE_INLINE)
+    sectors = 0;
+  if (sectors > 0 && inode->format == INODE_EXTENTS
+      && map_lookup (inode, sectors - 1) == INODE_INVALID_BLOCK_SECTOR)
+    extent_grow (inode, 0, sectors, false);
+  for (pos = 0; success && pos < (off_t) sectors * BLOCK_SECTOR_SIZE;
+       pos += BLOCK_SECTOR_SIZE)
+    success = byte_to_sector (inode, pos, true, pos)
+              != INODE_INVALID_BLOCK_SECTOR;
+  if (success && length > inode->length)
+    inode->length = length;
+  rwlock_release_write (&inode->lock);
+
+  return success;
+}
+
+/* Queues asynchronous reads of the sectors holding the SIZE bytes
+   of INODE starting at OFFSET, stopping at end of file. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+  block_sector_t sector;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+  {
+    if ((size_t) offset / BLOCK_SECTOR_SIZE >= inode->initialized) break;
+    sector = byte_to_sector (inode, offset, false, 0);
+    if (sector != INODE_INVALID_BLOCK_SECTOR)
+      buffercache_readahead (sector);
+  }
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
-  lock_acquire (&inode->lock);
+  rwlock_acquire_write (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-  lock_release (&inode->lock);
+  rwlock_release_write (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -573,9 +1861,9 @@ inode_allow_write (struct inode *inode)
 {
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-  lock_acquire (&inode->lock);
+  rwlock_acquire_write (&inode->lock);
   inode->deny_write_cnt--;
-  lock_release (&inode->lock);
+  rwlock_release_write (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -597,17 +1885,25 @@ bool inode_is_removed (const struct inode *i)
   return i->removed;
 }
 
+/* Returns the lock guarding the index of directory INODE. Lookups
+   hold it shared, changes to the index exclusively. */
+struct rwlock *
+inode_dir_lock (struct inode *inode)
+{
+  return &inode->dir_lock;
+}
+
 void inode_deny_remove (struct inode *inode)
 {
-  lock_acquire (&inode->lock);
+  rwlock_acquire_write (&inode->lock);
   inode->deny_remove_cnt++;
-  lock_release (&inode->lock);
+  rwlock_release_write (&inode->lock);
 }
 
 void inode_allow_remove (struct inode *inode)
 {
-  lock_acquire (&inode->lock);
+  rwlock_acquire_write (&inode->lock);
   inode->deny_remove_cnt--;
-  lock_release (&inode->lock);
+  rwlock_release_write (&inode->lock);
 }
 
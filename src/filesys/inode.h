@@ -8,6 +8,7 @@
 #define INODE_INVALID_BLOCK_SECTOR (block_sector_t)-1
 
 struct bitmap;
+struct rwlock;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool);
@@ -18,6 +19,9 @@ void inode_close (struct inode *);
 bool inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t offset, off_t size);
+void inode_sync (struct inode *);
+bool inode_allocate (struct inode *, off_t length);
 
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
@@ -28,5 +32,6 @@ void inode_allow_remove (struct inode *);
 off_t inode_length (const struct inode *);
 bool inode_is_directory (const struct inode *);
 bool inode_is_removed (const struct inode *i);
+struct rwlock *inode_dir_lock (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -11,8 +11,8 @@
    that can generate 32-bit x86 code without having any of the
    necessary libraries, including libgcc.  Thus, we can make
    Pintos work on these machines by simply implementing our own
-   64-bit division routines, which are the only routines from
-   libgcc that Pintos requires.
+   64-bit division routines and population count, which are the
+   only routines from libgcc that Pintos requires.
 
    Completeness is another reason to include these routines.  If
    Pintos is completely self-contained, then that makes it that
@@ -159,6 +159,7 @@ long long __divdi3 (long long n, long long d);
 long long __moddi3 (long long n, long long d);
 unsigned long long __udivdi3 (unsigned long long n, unsigned long long d);
 unsigned long long __umoddi3 (unsigned long long n, unsigned long long d);
+int __popcountsi2 (unsigned int x);
 
 /* Signed 64-bit division. */
 long long
@@ -187,3 +188,15 @@ __umoddi3 (unsigned long long n, unsigned long long d)
 {
   return umod64 (n, d);
 }
+
+/* Number of bits set, for __builtin_popcount() and
+   __builtin_popcountl(), which x86 has no instruction for before
+   POPCNT. */
+int
+__popcountsi2 (unsigned int x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
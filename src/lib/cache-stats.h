@@ -0,0 +1,23 @@
+#ifndef __LIB_CACHE_STATS_H
+#define __LIB_CACHE_STATS_H
+
+#include <stdint.h>
+
+/* Buffer cache counters, as returned by the cachestat() system
+   call. */
+struct cache_stats
+  {
+    uint64_t hits;              /* Lookups satisfied from the cache. */
+    uint64_t misses;            /* Lookups that loaded a sector. */
+    uint64_t meta_evictions;    /* Metadata sectors replaced. */
+    uint64_t regular_evictions; /* Regular sectors replaced. */
+    uint64_t readahead_issued;  /* Sectors loaded by readahead. */
+    uint64_t readahead_used;    /* ...later accessed. */
+    uint64_t readahead_wasted;  /* ...replaced without being accessed. */
+    uint64_t flushes;           /* Calls to flush the whole cache. */
+    uint64_t write_backs;       /* Sectors written back to disk. */
+    uint64_t waits;             /* Waits for an entry to change state. */
+    uint64_t wait_ticks;        /* Timer ticks spent in those waits. */
+  };
+
+#endif /* lib/cache-stats.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum characters in a file name in a struct dirent. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry and the inode it names, as returned by the
+   readdirplus() system call. */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    int length;                         /* File size in bytes. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[DIRENT_NAME_MAX + 1];     /* Null-terminated name. */
+  };
+
+#endif /* lib/dirent.h */
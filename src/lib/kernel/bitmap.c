@@ -71,6 +71,48 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type with bits LO through HI - 1 set, where
+   0 <= LO < HI <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t lo, size_t hi)
+{
+  elem_type high = hi < ELEM_BITS ? ((elem_type) 1 << hi) - 1
+                                  : (elem_type) -1;
+  return high & ~(((elem_type) 1 << lo) - 1);
+}
+
+/* Returns the number of bits set in E. */
+static inline size_t
+elem_popcount (elem_type e)
+{
+  return __builtin_popcountl (e);
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none. Skips
+   whole elements that hold no such bit. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx = elem_idx (start);
+  elem_type e;
+
+  if (start >= end)
+    return end;
+
+  e = (value ? b->bits[idx] : ~b->bits[idx])
+      & range_mask (start % ELEM_BITS, ELEM_BITS);
+  while (e == 0)
+    {
+      if (++idx >= elem_cnt (end))
+        return end;
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < end ? start : end;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -216,18 +258,33 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, an element
+   at a time. Each element is updated atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
+  size_t idx, hi;
+  elem_type mask;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      idx = elem_idx (start);
+      hi = end - idx * ELEM_BITS < ELEM_BITS ? end - idx * ELEM_BITS
+                                             : ELEM_BITS;
+      mask = range_mask (start % ELEM_BITS, hi);
+
+      /* See bitmap_mark() and bitmap_reset() */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      start = idx * ELEM_BITS + hi;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -235,16 +292,23 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t idx, hi, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      idx = elem_idx (start);
+      hi = end - idx * ELEM_BITS < ELEM_BITS ? end - idx * ELEM_BITS
+                                             : ELEM_BITS;
+      value_cnt += elem_popcount ((value ? b->bits[idx] : ~b->bits[idx])
+                                  & range_mask (start % ELEM_BITS, hi));
+      start = idx * ELEM_BITS + hi;
+    }
   return value_cnt;
 }
 
@@ -253,16 +317,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -294,20 +353,32 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Each candidate run is checked up to its first bit that is not
+   VALUE, and the search resumes at the next VALUE bit after that,
+   so no bit is looked at more than twice. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t i, j;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      for (i = start; i <= last; i = find_next (b, j, b->bit_cnt, value))
+        {
+          if (cnt == 0)
+            return i;
+          i = find_next (b, i, last + 1, value);
+          if (i > last)
+            break;
+          j = find_next (b, i, i + cnt, !value);
+          if (j == i + cnt)
+            return i; 
+        }
     }
   return BITMAP_ERROR;
 }
@@ -403,6 +474,24 @@ bitmap_write (struct bitmap *b, block_sector_t sector_begin)
   bitmap_block_ops (b, sector_begin, true);
   return true;
 }
+
+/* Copies sector IDX of the on-disk image of B, as written by
+   bitmap_write(), into the BLOCK_SECTOR_SIZE bytes at BUF. */
+void
+bitmap_get_sector (const struct bitmap *b, int idx, void *buf)
+{
+  size_t ofs = (size_t) idx * BLOCK_SECTOR_SIZE;
+  size_t num_bytes = byte_cnt (b->bit_cnt);
+  size_t n = 0;
+
+  ASSERT (idx >= 0 && idx < bitmap_sector_size (b));
+
+  if (ofs < num_bytes)
+    n = num_bytes - ofs < BLOCK_SECTOR_SIZE ? num_bytes - ofs
+                                            : BLOCK_SECTOR_SIZE;
+  memcpy (buf, (const char *) b->bits + ofs, n);
+  memset ((char *) buf + n, 0, BLOCK_SECTOR_SIZE - n);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -43,6 +43,7 @@ size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
 int bitmap_sector_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *b, block_sector_t sector_begin);
 bool bitmap_write (struct bitmap *b, block_sector_t sector_begin);
+void bitmap_get_sector (const struct bitmap *b, int idx, void *buf);
 #endif
 
 /* Debugging. */
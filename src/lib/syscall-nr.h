@@ -28,7 +28,17 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_CACHESTAT,              /* Reads buffer cache statistics. */
+    SYS_FSYNC,                  /* Writes a file's data to disk. */
+    SYS_FALLOCATE,              /* Allocates disk space for a file. */
+    SYS_READDIRPLUS,            /* Reads directory entries and inodes. */
+    SYS_OPENAT,                 /* Opens a file relative to a directory. */
+    SYS_CREATEAT,               /* Creates a file relative to a directory. */
+    SYS_MKDIRAT,                /* Creates a directory relative to one. */
+    SYS_REMOVEAT                /* Deletes a file relative to a directory. */
   };
 
 #endif /* lib/syscall-nr.h */
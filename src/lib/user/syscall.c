@@ -182,3 +182,51 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+cachestat (struct cache_stats *stats)
+{
+  return syscall1 (SYS_CACHESTAT, stats);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+fallocate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FALLOCATE, fd, length);
+}
+
+int
+readdirplus (int fd, struct dirent *entries, unsigned cnt)
+{
+  return syscall3 (SYS_READDIRPLUS, fd, entries, cnt);
+}
+
+int
+openat (int dirfd, const char *file)
+{
+  return syscall2 (SYS_OPENAT, dirfd, file);
+}
+
+bool
+createat (int dirfd, const char *file, unsigned initial_size)
+{
+  return syscall3 (SYS_CREATEAT, dirfd, file, initial_size);
+}
+
+bool
+mkdirat (int dirfd, const char *dir)
+{
+  return syscall2 (SYS_MKDIRAT, dirfd, dir);
+}
+
+bool
+removeat (int dirfd, const char *file)
+{
+  return syscall2 (SYS_REMOVEAT, dirfd, file);
+}
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <cache-stats.h>
+#include <dirent.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool cachestat (struct cache_stats *);
+bool fsync (int fd);
+bool fallocate (int fd, unsigned length);
+int readdirplus (int fd, struct dirent *entries, unsigned cnt);
+int openat (int dirfd, const char *file);
+bool createat (int dirfd, const char *file, unsigned initial_size);
+bool mkdirat (int dirfd, const char *dir);
+bool removeat (int dirfd, const char *file);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"hot" => ["h" x (8 * 512)],
+                "fill" => ["f" x (192 * 512)],
+                "scan" => ["s" x (256 * 512)]});
+pass;
@@ -0,0 +1,91 @@
+/* Run with the 2Q buffer cache policy. Reads a small file often
+   enough for it to reach the main queue, then reads a file much
+   larger than the buffer cache once. Checks that the scan did not
+   push the small file out of the cache. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_SECTORS 8
+#define FILL_SECTORS 192
+#define SCAN_SECTORS 256
+
+/* Fill sectors read between two reads of the hot file */
+#define FILL_PER_ROUND 8
+
+static char buf[HOT_SECTORS * 512];
+
+/* Creates NAME, SECTORS sectors long and filled with C, writes it
+   back and returns a descriptor for it. */
+static int
+make_file (const char *name, int sectors, char c)
+{
+  int fd, i;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  memset (buf, c, sizeof buf);
+  for (i = 0; i < sectors; i += HOT_SECTORS)
+    if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+      fail ("write to \"%s\" failed", name);
+  CHECK (fsync (fd), "fsync \"%s\"", name);
+  return fd;
+}
+
+/* Reads SIZE bytes at OFS from FD, which refers to NAME. */
+static void
+read_at (int fd, const char *name, int ofs, int size)
+{
+  seek (fd, ofs);
+  if (read (fd, buf, size) != size)
+    fail ("read of %d bytes at offset %d in \"%s\" failed",
+          size, ofs, name);
+}
+
+void
+test_main (void) 
+{
+  struct cache_stats before, after;
+  int hot, fill, scan;
+  int round, i, ofs;
+
+  hot = make_file ("hot", HOT_SECTORS, 'h');
+  fill = make_file ("fill", FILL_SECTORS, 'f');
+  scan = make_file ("scan", SCAN_SECTORS, 's');
+
+  /* Read the fill file backward, a sector at a time, so that it is
+     not read ahead and the hot file is evicted from A1in and read
+     again each time while it is still remembered */
+  ofs = FILL_SECTORS * 512;
+  for (round = 0; round < FILL_SECTORS / FILL_PER_ROUND; round++)
+    {
+      read_at (hot, "hot", 0, sizeof buf);
+      for (i = 0; i < FILL_PER_ROUND; i++)
+        {
+          ofs -= 512;
+          read_at (fill, "fill", ofs, 512);
+        }
+    }
+  msg ("read \"hot\" between reads of \"fill\"");
+
+  for (ofs = 0; ofs < SCAN_SECTORS * 512; ofs += sizeof buf)
+    read_at (scan, "scan", ofs, sizeof buf);
+  msg ("read \"scan\"");
+
+  CHECK (cachestat (&before), "cachestat");
+  read_at (hot, "hot", 0, sizeof buf);
+  CHECK (cachestat (&after), "cachestat");
+  if (after.misses - before.misses >= HOT_SECTORS / 2)
+    fail ("%d of %d sectors of \"hot\" missed after the scan",
+          (int) (after.misses - before.misses), HOT_SECTORS);
+  msg ("\"hot\" stayed cached");
+
+  msg ("close \"hot\"");
+  close (hot);
+  msg ("close \"fill\"");
+  close (fill);
+  msg ("close \"scan\"");
+  close (scan);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-2q) begin
+(cache-2q) create "hot"
+(cache-2q) open "hot"
+(cache-2q) fsync "hot"
+(cache-2q) create "fill"
+(cache-2q) open "fill"
+(cache-2q) fsync "fill"
+(cache-2q) create "scan"
+(cache-2q) open "scan"
+(cache-2q) fsync "scan"
+(cache-2q) read "hot" between reads of "fill"
+(cache-2q) read "scan"
+(cache-2q) cachestat
+(cache-2q) cachestat
+(cache-2q) "hot" stayed cached
+(cache-2q) close "hot"
+(cache-2q) close "fill"
+(cache-2q) close "scan"
+(cache-2q) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = join ('', map (chr (ord ('a') + $_ % 26) x 512, 0...33));
+check_archive ({"dirty" => [$contents]});
+pass;
@@ -0,0 +1,50 @@
+/* Dirties more than half of the buffer cache and checks that the
+   background cleaner writes it all back without an fsync. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* More than half of the 64 cache entries */
+#define SECTORS 34
+
+/* How many times to look before giving up on the cleaner */
+#define POLLS (1 << 22)
+
+static char block[512];
+
+void
+test_main (void) 
+{
+  struct cache_stats before, after;
+  const char *file_name = "dirty";
+  int fd, sector, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  CHECK (cachestat (&before), "cachestat");
+  for (sector = 0; sector < SECTORS; sector++)
+    {
+      memset (block, 'a' + sector % 26, sizeof block);
+      if (write (fd, block, sizeof block) != (int) sizeof block)
+        fail ("write of sector %d of \"%s\" failed", sector, file_name);
+    }
+  msg ("wrote %d sectors to \"%s\"", SECTORS, file_name);
+
+  for (i = 0; i < POLLS; i++)
+    {
+      if (!cachestat (&after))
+        fail ("cachestat failed");
+      if (after.write_backs - before.write_backs >= SECTORS)
+        break;
+    }
+  if (i == POLLS)
+    fail ("only %d of %d sectors were written back",
+          (int) (after.write_backs - before.write_backs), SECTORS);
+  msg ("cleaner wrote back \"%s\"", file_name);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
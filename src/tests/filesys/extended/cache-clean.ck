@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-clean) begin
+(cache-clean) create "dirty"
+(cache-clean) open "dirty"
+(cache-clean) cachestat
+(cache-clean) wrote 34 sectors to "dirty"
+(cache-clean) cleaner wrote back "dirty"
+(cache-clean) close "dirty"
+(cache-clean) end
+EOF
+pass;
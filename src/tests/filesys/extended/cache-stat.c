@@ -0,0 +1,34 @@
+/* Reads a file back twice and checks that cachestat() counts
+   the second read as buffer cache hits. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[2048];
+
+void
+test_main (void) 
+{
+  struct cache_stats before, after;
+  const char *file_name = "cached";
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read \"%s\"", file_name);
+
+  CHECK (cachestat (&before), "cachestat");
+  seek (fd, 0);
+  CHECK (read (fd, buf, sizeof buf) == (int) sizeof buf,
+         "read \"%s\" again", file_name);
+  CHECK (cachestat (&after), "cachestat");
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  if (after.hits <= before.hits)
+    fail ("second read of \"%s\" did not hit the cache", file_name);
+  if (after.misses < before.misses)
+    fail ("cache misses went down");
+}
@@ -0,0 +1,67 @@
+/* Child process for syn-cache.
+   Writes a file of its own, then reads the shared file and its
+   own file back in turns, checking every sector. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-cache.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-cache";
+
+static char block[512];
+
+/* Checks that FD, which refers to NAME, holds SECTORS sectors of
+   the file numbered ID. */
+static void
+check_sectors (int fd, const char *name, int id, int sectors)
+{
+  int sector;
+  size_t i;
+
+  seek (fd, 0);
+  for (sector = 0; sector < sectors; sector++)
+    {
+      if (read (fd, block, sizeof block) != (int) sizeof block)
+        fail ("read of sector %d of \"%s\" failed", sector, name);
+      for (i = 0; i < sizeof block; i++)
+        if (block[i] != syn_cache_byte (id, sector))
+          fail ("byte %zu of sector %d of \"%s\" is %d, expected %d",
+                i, sector, name, block[i], syn_cache_byte (id, sector));
+    }
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  char name[16];
+  int child_idx, shared, own, sector, round;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (name, sizeof name, "data%d", child_idx);
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((own = open (name)) > 1, "open \"%s\"", name);
+  for (sector = 0; sector < CHILD_SECTORS; sector++)
+    {
+      memset (block, syn_cache_byte (child_idx + 1, sector), sizeof block);
+      if (write (own, block, sizeof block) != (int) sizeof block)
+        fail ("write of sector %d of \"%s\" failed", sector, name);
+    }
+
+  CHECK ((shared = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      check_sectors (shared, shared_name, 0, SHARED_SECTORS);
+      check_sectors (own, name, child_idx + 1, CHILD_SECTORS);
+    }
+  close (shared);
+  close (own);
+
+  return child_idx;
+}
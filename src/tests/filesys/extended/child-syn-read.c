@@ -0,0 +1,47 @@
+/* Child process for syn-read.
+   Reads the part of the file its parent wrote before starting it,
+   in chunks of a size that depends on the child, so that the
+   children's reads start and end at different places in each
+   sector. */
+
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-read";
+
+static char buf[1024];
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx, fd, round, ofs, size, i;
+  int end = READ_SECTORS * 512;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  size = 200 + child_idx * 211;
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < end; ofs += size)
+        {
+          int want = end - ofs < size ? end - ofs : size;
+          if (read (fd, buf, want) != want)
+            fail ("read of %d bytes at offset %d in \"%s\" failed",
+                  want, ofs, file_name);
+          for (i = 0; i < want; i++)
+            if (buf[i] != syn_read_byte (ofs + i))
+              fail ("byte %d of \"%s\" is %d, expected %d",
+                    ofs + i, file_name, buf[i], syn_read_byte (ofs + i));
+        }
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my (%d) = map (("f" . sprintf ("%02d", $_) => [""]), grep ($_ % 2, 0...99));
+check_archive ({"d" => \%d});
+pass;
@@ -0,0 +1,62 @@
+/* Creates enough files in a directory for it to get a hash
+   index, then looks them up, removes half of them and checks
+   that lookups find exactly the ones that are left. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 100
+
+static void
+file_name (char name[], int i)
+{
+  snprintf (name, 16, "d/f%02d", i);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd, i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  msg ("created %d files in \"d\"", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  msg ("opened %d files in \"d\"", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      file_name (name, i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  msg ("removed even-numbered files");
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_name (name, i);
+      fd = open (name);
+      if (i % 2 == 0 && fd != -1)
+        fail ("open \"%s\" succeeded after it was removed", name);
+      else if (i % 2 != 0 && fd < 2)
+        fail ("open \"%s\" failed", name);
+      else if (fd != -1)
+        close (fd);
+    }
+  msg ("looked up %d files in \"d\"", FILE_CNT);
+}
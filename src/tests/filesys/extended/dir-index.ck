@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-index) begin
+(dir-index) mkdir "d"
+(dir-index) created 100 files in "d"
+(dir-index) opened 100 files in "d"
+(dir-index) removed even-numbered files
+(dir-index) looked up 100 files in "d"
+(dir-index) end
+EOF
+pass;
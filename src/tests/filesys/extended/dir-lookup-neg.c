@@ -0,0 +1,27 @@
+/* Looks up a name that does not exist, so that the failure may
+   be cached, then creates it and checks that the next lookup
+   finds it. Does the same again after removing it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (open ("a/x") == -1, "open \"a/x\" (must return -1)");
+  CHECK (create ("a/x", 0), "create \"a/x\"");
+  CHECK ((fd = open ("a/x")) > 1, "open \"a/x\"");
+  msg ("close \"a/x\"");
+  close (fd);
+
+  CHECK (remove ("a/x"), "remove \"a/x\"");
+  CHECK (open ("a/x") == -1, "open \"a/x\" (must return -1)");
+  CHECK (create ("a/x", 0), "create \"a/x\"");
+  CHECK ((fd = open ("a/x")) > 1, "open \"a/x\"");
+  msg ("close \"a/x\"");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-lookup-neg) begin
+(dir-lookup-neg) mkdir "a"
+(dir-lookup-neg) open "a/x" (must return -1)
+(dir-lookup-neg) create "a/x"
+(dir-lookup-neg) open "a/x"
+(dir-lookup-neg) close "a/x"
+(dir-lookup-neg) remove "a/x"
+(dir-lookup-neg) open "a/x" (must return -1)
+(dir-lookup-neg) create "a/x"
+(dir-lookup-neg) open "a/x"
+(dir-lookup-neg) close "a/x"
+(dir-lookup-neg) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Exercises openat(), createat(), mkdirat() and removeat() with
+   relative paths against a directory descriptor that is not the
+   current directory, checking the results with absolute paths. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int dir_fd, fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("b"), "mkdir \"b\"");
+  CHECK (chdir ("b"), "chdir \"b\"");
+  CHECK ((dir_fd = open ("/a")) > 1, "open \"/a\"");
+
+  CHECK (createat (dir_fd, "f", 10), "createat \"f\"");
+  CHECK ((fd = open ("/a/f")) > 1, "open \"/a/f\"");
+  CHECK (filesize (fd) == 10, "filesize \"/a/f\" is 10");
+  close (fd);
+  CHECK (open ("f") == -1, "open \"f\" in \"b\" (must return -1)");
+
+  CHECK ((fd = openat (dir_fd, "f")) > 1, "openat \"f\"");
+  CHECK (inumber (fd) != inumber (dir_fd), "inumber \"f\" is not \"/a\"");
+  close (fd);
+
+  CHECK (mkdirat (dir_fd, "d"), "mkdirat \"d\"");
+  CHECK (createat (dir_fd, "d/g", 0), "createat \"d/g\"");
+  CHECK ((fd = open ("/a/d/g")) > 1, "open \"/a/d/g\"");
+  close (fd);
+
+  CHECK (removeat (dir_fd, "f"), "removeat \"f\"");
+  CHECK (open ("/a/f") == -1, "open \"/a/f\" (must return -1)");
+  CHECK (openat (dir_fd, "f") == -1, "openat \"f\" (must return -1)");
+  close (dir_fd);
+}
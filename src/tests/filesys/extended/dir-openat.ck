@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-openat) begin
+(dir-openat) mkdir "a"
+(dir-openat) mkdir "b"
+(dir-openat) chdir "b"
+(dir-openat) open "/a"
+(dir-openat) createat "f"
+(dir-openat) open "/a/f"
+(dir-openat) filesize "/a/f" is 10
+(dir-openat) open "f" in "b" (must return -1)
+(dir-openat) openat "f"
+(dir-openat) inumber "f" is not "/a"
+(dir-openat) mkdirat "d"
+(dir-openat) createat "d/g"
+(dir-openat) open "/a/d/g"
+(dir-openat) removeat "f"
+(dir-openat) open "/a/f" (must return -1)
+(dir-openat) openat "f" (must return -1)
+(dir-openat) end
+EOF
+pass;
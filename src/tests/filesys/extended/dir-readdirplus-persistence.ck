@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"a" => {"small" => ["\0" x 100],
+                        "large" => ["\0" x 2000],
+                        "sub" => {}}});
+pass;
@@ -0,0 +1,63 @@
+/* Lists a directory with readdir() and with readdirplus(), and
+   checks that both return the same names, and that the inode
+   number, type and size readdirplus() returns for each agree with
+   opening it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_ENTRIES 8
+
+void
+test_main (void) 
+{
+  char names[MAX_ENTRIES][READDIR_MAX_LEN + 1];
+  struct dirent entries[MAX_ENTRIES];
+  char path[32];
+  int dir_fd, fd, cnt, first, rest, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (create ("a/small", 100), "create \"a/small\"");
+  CHECK (create ("a/large", 2000), "create \"a/large\"");
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  for (cnt = 0; cnt < MAX_ENTRIES && readdir (dir_fd, names[cnt]); cnt++)
+    continue;
+  msg ("readdir \"a\" returned %d entries", cnt);
+  close (dir_fd);
+
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  CHECK (readdirplus (dir_fd, entries, 0) == 0,
+         "readdirplus \"a\" for no entries");
+  first = readdirplus (dir_fd, entries, 2);
+  rest = readdirplus (dir_fd, entries + first, MAX_ENTRIES - first);
+  msg ("readdirplus \"a\" returned %d and %d entries", first, rest);
+  close (dir_fd);
+
+  if (first + rest != cnt)
+    fail ("readdir and readdirplus returned different entry counts");
+  for (i = 0; i < cnt; i++)
+    {
+      struct dirent *e = &entries[i];
+      if (strcmp (e->name, names[i]))
+        fail ("entry %d is \"%s\", readdir returned \"%s\"",
+              i, e->name, names[i]);
+
+      strlcpy (path, "a/", sizeof path);
+      strlcat (path, e->name, sizeof path);
+      if ((fd = open (path)) < 2)
+        fail ("open \"%s\" failed", path);
+      if (e->inumber != inumber (fd))
+        fail ("inode number of \"%s\" differs", path);
+      if (e->is_dir != isdir (fd))
+        fail ("type of \"%s\" differs", path);
+      if (e->length != filesize (fd))
+        fail ("size of \"%s\" is %d, readdirplus returned %d",
+              path, filesize (fd), e->length);
+      close (fd);
+    }
+  msg ("entries match");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-readdirplus) begin
+(dir-readdirplus) mkdir "a"
+(dir-readdirplus) create "a/small"
+(dir-readdirplus) create "a/large"
+(dir-readdirplus) mkdir "a/sub"
+(dir-readdirplus) open "a"
+(dir-readdirplus) readdir "a" returned 3 entries
+(dir-readdirplus) open "a"
+(dir-readdirplus) readdirplus "a" for no entries
+(dir-readdirplus) readdirplus "a" returned 2 and 1 entries
+(dir-readdirplus) entries match
+(dir-readdirplus) end
+EOF
+pass;
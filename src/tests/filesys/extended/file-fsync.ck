@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(file-fsync) begin
+(file-fsync) create "synced"
+(file-fsync) open "synced"
+(file-fsync) write "synced"
+(file-fsync) fsync "synced"
+(file-fsync) fsync unopened fd (must return false)
+(file-fsync) close "synced"
+(file-fsync) open "synced" for verification
+(file-fsync) verified contents of "synced"
+(file-fsync) close "synced"
+(file-fsync) end
+EOF
+pass;
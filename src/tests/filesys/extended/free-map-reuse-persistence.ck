@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Sector S of the file numbered ID is filled with one letter
+sub contents {
+    my ($id, $sectors) = @_;
+    return [join ('', map (chr (ord ('a') + ($id + $_) % 26) x 512,
+                           0...$sectors - 1))];
+}
+
+check_archive ({"old0" => contents (0, 96),
+		"old2" => contents (2, 96),
+		"old4" => contents (4, 96),
+		"old6" => contents (6, 96),
+		"new0" => contents (8, 128),
+		"new1" => contents (9, 128)});
+pass;
@@ -0,0 +1,67 @@
+/* Creates files, removes every other one and creates more, so that
+   the free map both gains and loses sectors before the file system
+   is unmounted. The persistence check then writes an archive of the
+   files to the same disk after remounting it, which overwrites any
+   sector of theirs that the free map on disk shows as free. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OLD_CNT 8
+#define OLD_SECTORS 96
+#define NEW_CNT 2
+#define NEW_SECTORS 128
+
+static char block[512];
+
+/* Creates NAME with SECTORS sectors, sector S of which is filled
+   with the letter ID + S places after 'a'. */
+static void
+make_file (const char *name, int id, int sectors)
+{
+  int fd, sector;
+
+  if (!create (name, 0))
+    fail ("create \"%s\" failed", name);
+  if ((fd = open (name)) < 2)
+    fail ("open \"%s\" failed", name);
+  for (sector = 0; sector < sectors; sector++)
+    {
+      memset (block, 'a' + (id + sector) % 26, sizeof block);
+      if (write (fd, block, sizeof block) != (int) sizeof block)
+        fail ("write of sector %d of \"%s\" failed", sector, name);
+    }
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  for (i = 0; i < OLD_CNT; i++)
+    {
+      snprintf (name, sizeof name, "old%d", i);
+      make_file (name, i, OLD_SECTORS);
+    }
+  msg ("created %d files of %d sectors", OLD_CNT, OLD_SECTORS);
+
+  for (i = 1; i < OLD_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "old%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  msg ("removed every other file");
+
+  for (i = 0; i < NEW_CNT; i++)
+    {
+      snprintf (name, sizeof name, "new%d", i);
+      make_file (name, OLD_CNT + i, NEW_SECTORS);
+    }
+  msg ("created %d files of %d sectors", NEW_CNT, NEW_SECTORS);
+}
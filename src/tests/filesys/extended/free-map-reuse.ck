@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(free-map-reuse) begin
+(free-map-reuse) created 8 files of 96 sectors
+(free-map-reuse) removed every other file
+(free-map-reuse) created 2 files of 128 sectors
+(free-map-reuse) end
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Allocates space for an empty file with fallocate() and checks
+   that the file grew and reads back as zeros. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[23456];
+
+void
+test_main (void) 
+{
+  const char *file_name = "falloc";
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fallocate (fd, sizeof buf), "fallocate \"%s\"", file_name);
+  CHECK (filesize (fd) == (int) sizeof buf,
+         "filesize \"%s\" is %zu", file_name, sizeof buf);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-fallocate) begin
+(grow-fallocate) create "falloc"
+(grow-fallocate) open "falloc"
+(grow-fallocate) fallocate "falloc"
+(grow-fallocate) filesize "falloc" is 23456
+(grow-fallocate) close "falloc"
+(grow-fallocate) open "falloc" for verification
+(grow-fallocate) verified contents of "falloc"
+(grow-fallocate) close "falloc"
+(grow-fallocate) end
+EOF
+pass;
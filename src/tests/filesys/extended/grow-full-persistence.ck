@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = join ('', map (chr (ord ('a') + $_ % 26) x 512, 0...63));
+check_archive ({"after" => [$contents]});
+pass;
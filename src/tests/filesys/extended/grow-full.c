@@ -0,0 +1,95 @@
+/* Fills the disk with one file until a write comes up short,
+   removes the file and fills the disk again. The free map is
+   searched, counted and updated a word at a time, so this runs
+   those operations over every word of it, full and empty. Checks
+   that the file reads back both times, that the second fill gets
+   about as far as the first, and that space can be allocated
+   again afterward. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SECTORS 8
+
+/* Fills differ by at most this many sectors */
+#define SLACK_SECTORS 16
+
+#define AFTER_SECTORS 64
+
+static char buf[CHUNK_SECTORS * 512];
+
+/* Fills sector SECTOR of a file with its own letter. */
+static void
+fill_sector (char *p, int sector)
+{
+  memset (p, 'a' + sector % 26, 512);
+}
+
+/* Writes NAME until the disk is full, checks what was written and
+   removes it. Returns the number of bytes written. */
+static int
+fill_disk (const char *name)
+{
+  int fd, size, wrote, sector, ofs, i;
+
+  if (!create (name, 0))
+    fail ("create \"%s\" failed", name);
+  if ((fd = open (name)) < 2)
+    fail ("open \"%s\" failed", name);
+  for (size = 0; ; size += wrote)
+    {
+      for (i = 0; i < CHUNK_SECTORS; i++)
+        fill_sector (buf + i * 512, size / 512 + i);
+      wrote = write (fd, buf, sizeof buf);
+      if (wrote < (int) sizeof buf)
+        break;
+    }
+  if (wrote > 0)
+    size += wrote;
+  if (filesize (fd) != size)
+    fail ("\"%s\" is %d bytes, but %d were written", name,
+          filesize (fd), size);
+
+  seek (fd, 0);
+  for (ofs = 0; ofs < size; ofs += 512)
+    {
+      int want = size - ofs < 512 ? size - ofs : 512;
+      if (read (fd, buf, want) != want)
+        fail ("read at offset %d in \"%s\" failed", ofs, name);
+      fill_sector (buf + 512, ofs / 512);
+      if (memcmp (buf, buf + 512, want))
+        fail ("sector %d of \"%s\" differs", ofs / 512, name);
+    }
+  close (fd);
+  if (!remove (name))
+    fail ("remove \"%s\" failed", name);
+  return size;
+}
+
+void
+test_main (void) 
+{
+  int first, second, fd, sector;
+
+  first = fill_disk ("full");
+  msg ("filled the disk");
+  second = fill_disk ("full");
+  msg ("filled the disk again");
+  if (second < first - SLACK_SECTORS * 512
+      || second > first + SLACK_SECTORS * 512)
+    fail ("first fill wrote %d bytes, second %d", first, second);
+
+  CHECK (create ("after", 0), "create \"after\"");
+  CHECK ((fd = open ("after")) > 1, "open \"after\"");
+  for (sector = 0; sector < AFTER_SECTORS; sector++)
+    {
+      fill_sector (buf, sector);
+      if (write (fd, buf, 512) != 512)
+        fail ("write of sector %d of \"after\" failed", sector);
+    }
+  msg ("wrote %d sectors to \"after\"", AFTER_SECTORS);
+  msg ("close \"after\"");
+  close (fd);
+}
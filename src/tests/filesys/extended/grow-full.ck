@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-full) begin
+(grow-full) filled the disk
+(grow-full) filled the disk again
+(grow-full) create "after"
+(grow-full) open "after"
+(grow-full) wrote 64 sectors to "after"
+(grow-full) close "after"
+(grow-full) end
+EOF
+pass;
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Sector S of file ID is filled with one letter
+sub contents {
+    my ($id) = @_;
+    return [join ('', map (chr (ord ('a') + ($id * 7 + $_) % 26) x 512,
+                           0...239))];
+}
+
+check_archive ({"a" => {"f" => contents (0)},
+		"b" => {"f" => contents (1)},
+		"c" => {"f" => contents (2)}});
+pass;
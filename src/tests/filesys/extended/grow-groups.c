@@ -0,0 +1,69 @@
+/* Grows files in three directories by turns, two sectors at a
+   time, until together they take more than an allocation group, so
+   that the allocator places each file near its directory while the
+   others compete for the same groups and their cursors. Checks that
+   every file reads back correctly. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 3
+#define SECTORS 240
+#define STEP 2
+
+static char block[STEP * 512];
+
+/* Returns the letter filling sector SECTOR of file ID. */
+static char
+fill (int id, int sector)
+{
+  return 'a' + (id * 7 + sector) % 26;
+}
+
+void
+test_main (void) 
+{
+  char dir[2] = "a", name[8];
+  int fd[FILE_CNT];
+  int i, sector, s;
+  size_t j;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      dir[0] = 'a' + i;
+      snprintf (name, sizeof name, "%s/f", dir);
+      CHECK (mkdir (dir), "mkdir \"%s\"", dir);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd[i] = open (name)) > 1, "open \"%s\"", name);
+    }
+
+  for (sector = 0; sector < SECTORS; sector += STEP)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        for (s = 0; s < STEP; s++)
+          memset (block + s * 512, fill (i, sector + s), 512);
+        if (write (fd[i], block, sizeof block) != (int) sizeof block)
+          fail ("write at sector %d of file %d failed", sector, i);
+      }
+  msg ("grew %d files to %d sectors by turns", FILE_CNT, SECTORS);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      seek (fd[i], 0);
+      for (sector = 0; sector < SECTORS; sector += STEP)
+        {
+          if (read (fd[i], block, sizeof block) != (int) sizeof block)
+            fail ("read at sector %d of file %d failed", sector, i);
+          for (j = 0; j < sizeof block; j++)
+            if (block[j] != fill (i, sector + j / 512))
+              fail ("byte %zu of sector %d of file %d is %d, expected %d",
+                    j % 512, sector + j / 512, i, block[j],
+                    fill (i, sector + j / 512));
+        }
+      close (fd[i]);
+    }
+  msg ("verified %d files", FILE_CNT);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-groups) begin
+(grow-groups) mkdir "a"
+(grow-groups) create "a/f"
+(grow-groups) open "a/f"
+(grow-groups) mkdir "b"
+(grow-groups) create "b/f"
+(grow-groups) open "b/f"
+(grow-groups) mkdir "c"
+(grow-groups) create "c/f"
+(grow-groups) open "c/f"
+(grow-groups) grew 3 files to 240 sectors by turns
+(grow-groups) verified 3 files
+(grow-groups) end
+EOF
+pass;
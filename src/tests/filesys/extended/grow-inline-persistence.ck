@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"inline" => ["a" x 300 . "b" x 1200]});
+pass;
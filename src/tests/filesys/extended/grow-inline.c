@@ -0,0 +1,36 @@
+/* Writes a file small enough to be stored in its inode, then
+   grows it past that size so that its data has to move out into
+   blocks of its own, and checks that none of it is lost. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL 300
+#define LARGE 1500
+
+static char buf[LARGE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "inline";
+  int fd;
+
+  memset (buf, 'a', SMALL);
+  memset (buf + SMALL, 'b', LARGE - SMALL);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, SMALL) == SMALL,
+         "write %d bytes to \"%s\"", SMALL, file_name);
+  seek (fd, 0);
+  check_file_handle (fd, file_name, buf, SMALL);
+  seek (fd, SMALL);
+  CHECK (write (fd, buf + SMALL, LARGE - SMALL) == LARGE - SMALL,
+         "write %d more bytes to \"%s\"", LARGE - SMALL, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, LARGE);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-inline) begin
+(grow-inline) create "inline"
+(grow-inline) open "inline"
+(grow-inline) write 300 bytes to "inline"
+(grow-inline) verified contents of "inline"
+(grow-inline) write 1200 more bytes to "inline"
+(grow-inline) close "inline"
+(grow-inline) open "inline" for verification
+(grow-inline) verified contents of "inline"
+(grow-inline) close "inline"
+(grow-inline) end
+EOF
+pass;
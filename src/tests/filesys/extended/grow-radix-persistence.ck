@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = "\0" x (40 * 20480 + 1);
+substr ($contents, $_ * 20480, 1) = chr (ord ('a') + $_ % 26) foreach 1...40;
+check_archive ({"radix" => [$contents]});
+pass;
@@ -0,0 +1,59 @@
+/* Writes single bytes far enough apart that every write leaves a
+   hole before it, which fragments the file into more runs than an
+   inode's extent table holds and makes it switch to the radix
+   format. Checks that the bytes and the holes between them read
+   back correctly. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* More blocks than are allocated ahead of an append, so that each
+   write starts a new run after a hole. */
+#define STRIDE (40 * 512)
+#define WRITES 40
+
+static char
+marker (int i)
+{
+  return 'a' + i % 26;
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "radix";
+  char block[512];
+  int fd, i, ofs;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 1; i <= WRITES; i++)
+    {
+      char c = marker (i);
+      seek (fd, i * STRIDE);
+      if (write (fd, &c, 1) != 1)
+        fail ("write at offset %d in \"%s\" failed", i * STRIDE, file_name);
+    }
+  msg ("wrote %d bytes %d bytes apart", WRITES, STRIDE);
+
+  seek (fd, 0);
+  for (ofs = 0; ofs <= WRITES * STRIDE; ofs += sizeof block)
+    {
+      int size = ofs < WRITES * STRIDE ? (int) sizeof block : 1;
+      if (read (fd, block, size) != size)
+        fail ("read of %d bytes at offset %d in \"%s\" failed",
+              size, ofs, file_name);
+      for (i = 0; i < size; i++)
+        {
+          char expected = ofs > 0 && ofs % STRIDE == 0 && i == 0
+                          ? marker (ofs / STRIDE) : 0;
+          if (block[i] != expected)
+            fail ("byte %d of \"%s\" is %d, expected %d",
+                  ofs + i, file_name, block[i], expected);
+        }
+    }
+  msg ("verified contents of \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
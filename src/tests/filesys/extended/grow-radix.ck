@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-radix) begin
+(grow-radix) create "radix"
+(grow-radix) open "radix"
+(grow-radix) wrote 40 bytes 20480 bytes apart
+(grow-radix) verified contents of "radix"
+(grow-radix) close "radix"
+(grow-radix) end
+EOF
+pass;
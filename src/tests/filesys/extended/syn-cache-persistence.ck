@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Sector S of the file numbered ID is filled with one letter
+sub contents {
+    my ($id, $sectors) = @_;
+    return join ('', map (chr (ord ('a') + ($id + $_) % 26) x 512,
+                          0...$sectors - 1));
+}
+
+check_archive ({"child-syn-cache" => "tests/filesys/extended/child-syn-cache",
+		"shared" => [contents (0, 64)],
+		"data0" => [contents (1, 48)],
+		"data1" => [contents (2, 48)],
+		"data2" => [contents (3, 48)],
+		"data3" => [contents (4, 48)]});
+pass;
@@ -0,0 +1,50 @@
+/* Rewrites a file in place while subprocesses read it, and write
+   and read back files of their own, so that many processes hit
+   and replace buffer cache entries at once. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-cache.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char block[512];
+
+/* Writes the contents of the shared file to FD. */
+static void
+write_shared (int fd)
+{
+  int sector;
+
+  seek (fd, 0);
+  for (sector = 0; sector < SHARED_SECTORS; sector++)
+    {
+      memset (block, syn_cache_byte (0, sector), sizeof block);
+      if (write (fd, block, sizeof block) != (int) sizeof block)
+        fail ("write of sector %d of \"%s\" failed", sector, shared_name);
+    }
+}
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd, round;
+
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  write_shared (fd);
+  msg ("wrote \"%s\"", shared_name);
+
+  exec_children ("child-syn-cache", children, CHILD_CNT);
+
+  /* The same bytes go back, so readers see them whichever write
+     they overlap */
+  for (round = 0; round < ROUNDS; round++)
+    write_shared (fd);
+  msg ("rewrote \"%s\" %d times", shared_name, ROUNDS);
+
+  wait_children (children, CHILD_CNT);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-cache) begin
+(syn-cache) create "shared"
+(syn-cache) open "shared"
+(syn-cache) wrote "shared"
+(syn-cache) exec child 1 of 4: "child-syn-cache 0"
+(syn-cache) exec child 2 of 4: "child-syn-cache 1"
+(syn-cache) exec child 3 of 4: "child-syn-cache 2"
+(syn-cache) exec child 4 of 4: "child-syn-cache 3"
+(syn-cache) rewrote "shared" 3 times
+(syn-cache) wait for child 1 of 4 returned 0 (expected 0)
+(syn-cache) wait for child 2 of 4 returned 1 (expected 1)
+(syn-cache) wait for child 3 of 4 returned 2 (expected 2)
+(syn-cache) wait for child 4 of 4 returned 3 (expected 3)
+(syn-cache) close "shared"
+(syn-cache) end
+EOF
+pass;
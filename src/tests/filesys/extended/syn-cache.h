@@ -0,0 +1,20 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_CACHE_H
+#define TESTS_FILESYS_EXTENDED_SYN_CACHE_H
+
+/* Together the files take four times as many sectors as the
+   buffer cache holds. */
+#define SHARED_SECTORS 64
+#define CHILD_SECTORS 48
+#define CHILD_CNT 4
+#define ROUNDS 3
+static const char shared_name[] = "shared";
+
+/* Returns the byte that fills sector SECTOR of the file numbered
+   ID: the shared file is 0, child I's file is I + 1. */
+static inline char
+syn_cache_byte (int id, int sector)
+{
+  return 'a' + (id + sector) % 26;
+}
+
+#endif /* tests/filesys/extended/syn-cache.h */
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($contents) = join ('', map (chr (ord ('a')
+                                     + ($_ % 512 * 7 + int ($_ / 512)) % 26),
+                                0...200 * 512 - 1));
+check_archive ({"child-syn-read" => "tests/filesys/extended/child-syn-read",
+		"readfile" => [$contents]});
+pass;
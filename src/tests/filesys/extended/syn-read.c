@@ -0,0 +1,47 @@
+/* Appends to a file while subprocesses read the part of it that
+   was written first, so that readers share the file's inode while
+   the writer needs it to itself to allocate blocks. */
+
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char block[512];
+
+/* Writes sectors FIRST through LAST - 1 of the file to FD. */
+static void
+write_sectors (int fd, int first, int last)
+{
+  int sector;
+  size_t i;
+
+  for (sector = first; sector < last; sector++)
+    {
+      for (i = 0; i < sizeof block; i++)
+        block[i] = syn_read_byte (sector * 512 + i);
+      if (write (fd, block, sizeof block) != (int) sizeof block)
+        fail ("write of sector %d of \"%s\" failed", sector, file_name);
+    }
+}
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  write_sectors (fd, 0, READ_SECTORS);
+  msg ("wrote %d sectors to \"%s\"", READ_SECTORS, file_name);
+
+  exec_children ("child-syn-read", children, CHILD_CNT);
+
+  write_sectors (fd, READ_SECTORS, READ_SECTORS + APPEND_SECTORS);
+  msg ("appended %d sectors to \"%s\"", APPEND_SECTORS, file_name);
+
+  wait_children (children, CHILD_CNT);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
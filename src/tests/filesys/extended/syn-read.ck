@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-read) begin
+(syn-read) create "readfile"
+(syn-read) open "readfile"
+(syn-read) wrote 100 sectors to "readfile"
+(syn-read) exec child 1 of 4: "child-syn-read 0"
+(syn-read) exec child 2 of 4: "child-syn-read 1"
+(syn-read) exec child 3 of 4: "child-syn-read 2"
+(syn-read) exec child 4 of 4: "child-syn-read 3"
+(syn-read) appended 100 sectors to "readfile"
+(syn-read) wait for child 1 of 4 returned 0 (expected 0)
+(syn-read) wait for child 2 of 4 returned 1 (expected 1)
+(syn-read) wait for child 3 of 4 returned 2 (expected 2)
+(syn-read) wait for child 4 of 4 returned 3 (expected 3)
+(syn-read) close "readfile"
+(syn-read) end
+EOF
+pass;
@@ -0,0 +1,19 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_READ_H
+#define TESTS_FILESYS_EXTENDED_SYN_READ_H
+
+#define READ_SECTORS 100
+#define APPEND_SECTORS 100
+#define CHILD_CNT 4
+#define ROUNDS 3
+static const char file_name[] = "readfile";
+
+/* Returns the byte at offset OFS of the file. It differs between
+   neighbouring bytes and between the same byte of different
+   sectors. */
+static inline char
+syn_read_byte (int ofs)
+{
+  return 'a' + (ofs % 512 * 7 + ofs / 512) % 26;
+}
+
+#endif /* tests/filesys/extended/syn-read.h */
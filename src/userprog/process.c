@@ -14,6 +14,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
@@ -662,10 +663,11 @@ get_process_fd (struct thread *t, int fd)
 }
 
 /* this function is not responsible for freeing filename but expects
-   it to be valid memory while the process fd is still in the list */
+   it to be valid memory while the process fd is still in the list.
+   The new fd takes over the caller's reference to DIR. */
 int 
 process_add_file (struct thread *t, struct file *file, 
-                  const char* filename)
+                  struct inode *dir, const char* filename)
 {
   struct list *fd_list = &t->fd_list;
 
@@ -673,6 +675,7 @@ process_add_file (struct thread *t, struct file *file,
   if (new_fd == NULL) return -1;
   new_fd->file = file;
   new_fd->fd = t->next_fd++;
+  new_fd->dir = dir;
   new_fd->filename = strdup (filename);
 
   if (new_fd->filename == NULL) 
@@ -699,23 +702,27 @@ process_remove_file (struct thread *t, int fd)
 
   if (pfd == NULL) return;
   list_remove (&pfd->elem);
+  inode_close (pfd->dir);
   free (pfd->filename);
   free (pfd);
 }
 
 struct process_mmap* 
-mmap_create (const char *filename)
+mmap_create (int fd)
 {
-  ASSERT (filename != NULL);
   struct process_mmap *mmap = malloc (sizeof (struct process_mmap));
   if (mmap == NULL)
     return NULL;
 
   /* Make a copy of the file struct. */
-  int fd = syscall_open (filename);
-  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  struct process_fd *pfd = process_get_file (thread_current (),
+                                             syscall_reopen (fd));
+  if (pfd == NULL)
+  {
+    free (mmap);
+    return NULL;
+  }
   struct file * file = pfd->file;
-  if (file == NULL) return NULL;
 
   list_init (&mmap->entries);
   mmap->size = file_length (file);
@@ -15,6 +15,8 @@ struct process_fd
   const char* filename;      /* This memory does not need to be freed
                                 because it is handled by the global
                                 list of file descriptors in syscall.c*/
+  struct inode *dir;         /* Directory that filename is relative to,
+                                kept open so its sector is not reused */
   int fd;
 };
 
@@ -58,13 +60,13 @@ bool process_create_pcb (struct thread *t);
 /* Functions for manipulating the mapping between fd and file* for
    a given process */
 int process_add_file (struct thread *t, struct file *file, 
-  const char* filename);
+  struct inode *dir, const char* filename);
 struct process_fd* process_get_file (struct thread *t, int fd);
 void process_remove_file (struct thread *t, int fd);
 
 /* Functions for manipulating mmapps for a given process */
 struct process_mmap* 
-mmap_create (const char *filename);
+mmap_create (int fd);
 bool mmap_add (struct process_mmap *mmap, void* uaddr, 
                    unsigned offset);
 void mmap_destroy (struct process_mmap *mmap);
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <dirent.h>
 #include <syscall-nr.h>
 #include <hash.h>
 #include <string.h>
@@ -9,6 +10,7 @@
 #include "devices/shutdown.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "filesys/buffercache.h"
 #include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -61,6 +63,9 @@ hash_less_fd_hash (const struct hash_elem *a, const struct hash_elem *b,
 }
 
 static void syscall_handler (struct intr_frame *);
+static bool remove_at (block_sector_t dir, const char *filename);
+static int fd_install (struct file *file, struct inode *dir,
+                       const char *filename);
 
 /* Reads a byte at user virtual address UADDR. UADDR must be below
    PHYS_BASE.  Returns the byte value if successful, -1 if a segfault
@@ -321,13 +326,21 @@ sys_create (const struct intr_frame *f)
 static bool
 sys_remove (const struct intr_frame *f)
 {
-  ASSERT (!lock_held_by_current_thread (&fd_all_lock));
-
   const char *filename = frame_arg_ptr (f, 1);
   memory_verify_string (filename);
 
-  struct file* file = filesys_open (filename);
-  if (file == NULL) return -1;
+  return remove_at (thread_get_cwd (), filename);
+}
+
+/* Removes FILENAME, relative to the directory at sector DIR. If the
+   file is open, it is removed when the last descriptor is closed. */
+static bool
+remove_at (block_sector_t dir, const char *filename)
+{
+  ASSERT (!lock_held_by_current_thread (&fd_all_lock));
+
+  struct file* file = filesys_open_at (dir, filename);
+  if (file == NULL) return false;
   int inumber = file_inumber (file);
   file_close (file);
 
@@ -341,7 +354,7 @@ sys_remove (const struct intr_frame *f)
     fd_found->delete = true;
     result = true;
   } else {
-    result = filesys_remove (filename);
+    result = filesys_remove_at (dir, filename);
   }
   lock_release (&fd_all_lock);
 
@@ -350,17 +363,63 @@ sys_remove (const struct intr_frame *f)
 
 int
 syscall_open (const char *filename)
+{
+  if (cwd_deleted (filename)) return -1;
+
+  return syscall_open_at (thread_get_cwd (), filename);
+}
+
+/* Opens FILENAME, relative to the directory at sector DIR, and
+   returns a new file descriptor for it, or -1 on failure. */
+int
+syscall_open_at (block_sector_t dir, const char *filename)
 {
   ASSERT (!lock_held_by_current_thread (&fd_all_lock));
 
-  struct fd_hash *fd_found;
+  struct inode *base;
   struct file* file;
 
-  if (cwd_deleted (filename)) return -1;
+  base = inode_open (dir);
+  if (base == NULL) return -1;
+  file = filesys_open_at (dir, filename);
+  if (file == NULL)
+  {
+    inode_close (base);
+    return -1;
+  }
+
+  return fd_install (file, base, filename);
+}
+
+/* Opens the file open as FD again under a new file descriptor.
+   Unlike opening it by name, this reaches the same file even if
+   the name has been removed or its directory replaced since.
+   Returns the new descriptor, or -1 on failure. */
+int
+syscall_reopen (int fd)
+{
+  ASSERT (!lock_held_by_current_thread (&fd_all_lock));
+
+  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  struct file *file;
 
-  file = filesys_open (filename);
+  if (pfd == NULL) return -1;
+  file = file_reopen (pfd->file);
   if (file == NULL) return -1;
 
+  return fd_install (file, inode_reopen (pfd->dir), pfd->filename);
+}
+
+/* Gives FILE, opened as FILENAME relative to directory DIR, a new
+   file descriptor in the current process, taking over the caller's
+   references to both. Returns the descriptor, or -1 on failure,
+   in which case FILE and DIR are closed. */
+static int
+fd_install (struct file *file, struct inode *dir, const char *filename)
+{
+  struct fd_hash *fd_found;
+  int fd;
+
   lock_acquire (&fd_all_lock);
   fd_found = get_fd_hash (file_inumber (file));
 
@@ -369,27 +428,38 @@ syscall_open (const char *filename)
   {
     fd_found = fd_hash_init ();
     if (fd_found == NULL)
-    {
-      lock_release (&fd_all_lock);
-      return -1;
-    }
+      goto fail;
     fd_found->inumber = file_inumber (file);
     hash_insert (&fd_all, &fd_found->elem);
   }
   /* Makes sure it isn't marked for deletion */
   if (fd_found->delete)
-  {
-    lock_release (&fd_all_lock);
-    return -1;
-  }
+    goto fail;
 
   fd_found->count++;
   lock_release (&fd_all_lock);
 
-  int fd = process_add_file (thread_current (),
-                             file, filename);
-
+  fd = process_add_file (thread_current (), file, dir, filename);
+  if (fd < 0)
+  {
+    lock_acquire (&fd_all_lock);
+    file_close (file);
+    if (--fd_found->count == 0)
+    {
+      if (fd_found->delete)
+        filesys_remove_at (inode_get_inumber (dir), filename);
+      fd_hash_destroy (fd_found);
+    }
+    lock_release (&fd_all_lock);
+    inode_close (dir);
+  }
   return fd;
+
+ fail:
+  lock_release (&fd_all_lock);
+  file_close (file);
+  inode_close (dir);
+  return -1;
 }
 
 static int
@@ -459,7 +529,8 @@ syscall_close (int fd)
   fd_found->count--;
   if (fd_found->count == 0)
   {
-    if (fd_found->delete) filesys_remove (pfd->filename);
+    if (fd_found->delete)
+      filesys_remove_at (inode_get_inumber (pfd->dir), pfd->filename);
     fd_hash_destroy(fd_found);
   }
   lock_release (&fd_all_lock);
@@ -571,6 +642,191 @@ sys_inumber (struct intr_frame *f)
   return file_inumber (pfd->file);
 }
 
+/**
+ * Copies the buffer cache statistics into the struct cache_stats at stats.
+ * Returns true if successful.
+ */
+static bool
+sys_cachestat (struct intr_frame *f)
+{
+  struct cache_stats *dst = frame_arg_ptr (f, 1);
+  struct cache_stats stats;
+
+  memory_verify_write (dst, sizeof *dst);
+
+  buffercache_get_stats (&stats);
+  memcpy (dst, &stats, sizeof stats);
+  return true;
+}
+
+/**
+ * Writes the data and metadata of the file open as fd that are still only in
+ * the buffer cache to disk. Returns true if successful, false if fd is not
+ * open.
+ */
+static bool
+sys_fsync (struct intr_frame *f)
+{
+  int fd = frame_arg_int (f, 1);
+
+  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  if (pfd == NULL) return false;
+
+  file_sync (pfd->file);
+  return true;
+}
+
+/**
+ * Allocates disk space for the first length bytes of the file open as fd,
+ * in as few contiguous runs as possible, and extends the file to length bytes
+ * if it is shorter. Returns true if successful, false if fd is not an open
+ * ordinary file or the disk is full.
+ */
+static bool
+sys_fallocate (struct intr_frame *f)
+{
+  int fd = frame_arg_int (f, 1);
+  int length = frame_arg_int (f, 2);
+
+  /* No file can be larger than the disk */
+  if (length < 0
+      || (uint64_t) length > (uint64_t) block_size (fs_device)
+                             * BLOCK_SECTOR_SIZE)
+    return false;
+
+  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  if (pfd == NULL || file_is_directory (pfd->file)) return false;
+
+  return file_allocate (pfd->file, length);
+}
+
+/**
+ * Reads up to cnt of the next entries of the directory open as fd into the
+ * array of struct dirent at entries, each with the inode number, type and
+ * length of the file it names, so that a directory can be listed without
+ * opening every file in it. Returns the number of entries read, 0 at the end
+ * of the directory, or -1 if fd is not an open directory.
+ */
+static int
+sys_readdirplus (struct intr_frame *f)
+{
+  int fd = frame_arg_int (f, 1);
+  struct dirent *dst = frame_arg_ptr (f, 2);
+  unsigned cnt = frame_arg_int (f, 3);
+  struct dirent *buf;
+  int n;
+
+  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  if (pfd == NULL || !file_is_directory (pfd->file)) return -1;
+  if (cnt == 0) return 0;
+
+  if (cnt > PGSIZE / sizeof *dst)
+    cnt = PGSIZE / sizeof *dst;
+  memory_verify_write (dst, cnt * sizeof *dst);
+
+  buf = malloc (cnt * sizeof *buf);
+  if (buf == NULL) return -1;
+  n = file_readdir_plus (pfd->file, buf, cnt);
+  memcpy (dst, buf, n * sizeof *buf);
+  free (buf);
+
+  return n;
+}
+
+/* Returns the sector of the directory open as fd, or
+   INODE_INVALID_BLOCK_SECTOR if fd is not an open directory or the
+   directory is to be removed. */
+static block_sector_t
+fd_dir (int fd)
+{
+  struct process_fd *pfd = process_get_file (thread_current (), fd);
+  struct fd_hash *fd_found;
+  block_sector_t sector;
+  bool deleted;
+
+  if (pfd == NULL || !file_is_directory (pfd->file))
+    return INODE_INVALID_BLOCK_SECTOR;
+  sector = file_inumber (pfd->file);
+
+  lock_acquire (&fd_all_lock);
+  fd_found = get_fd_hash (sector);
+  deleted = fd_found != NULL && fd_found->delete;
+  lock_release (&fd_all_lock);
+
+  return deleted ? INODE_INVALID_BLOCK_SECTOR : sector;
+}
+
+/**
+ * Opens the file called file, looking a relative path up from the directory
+ * open as dirfd instead of the current directory. Returns a new file
+ * descriptor, or -1 if dirfd is not an open directory or the file could not
+ * be opened.
+ */
+static int
+sys_openat (struct intr_frame *f)
+{
+  int dirfd = frame_arg_int (f, 1);
+  const char *filename = frame_arg_ptr (f, 2);
+  memory_verify_string (filename);
+
+  block_sector_t dir = fd_dir (dirfd);
+  if (dir == INODE_INVALID_BLOCK_SECTOR) return -1;
+
+  return syscall_open_at (dir, filename);
+}
+
+/**
+ * Like create, but looks a relative path up from the directory open as
+ * dirfd. Returns false if dirfd is not an open directory.
+ */
+static bool
+sys_createat (struct intr_frame *f)
+{
+  int dirfd = frame_arg_int (f, 1);
+  const char *filename = frame_arg_ptr (f, 2);
+  uint32_t initial_size = frame_arg_int (f, 3);
+  memory_verify_string (filename);
+
+  block_sector_t dir = fd_dir (dirfd);
+  if (dir == INODE_INVALID_BLOCK_SECTOR) return false;
+
+  return filesys_create_at (dir, filename, initial_size);
+}
+
+/**
+ * Like mkdir, but looks a relative path up from the directory open as dirfd.
+ * Returns false if dirfd is not an open directory.
+ */
+static bool
+sys_mkdirat (struct intr_frame *f)
+{
+  int dirfd = frame_arg_int (f, 1);
+  const char *dirname = frame_arg_ptr (f, 2);
+  memory_verify_string (dirname);
+
+  block_sector_t dir = fd_dir (dirfd);
+  if (dir == INODE_INVALID_BLOCK_SECTOR) return false;
+
+  return filesys_mkdir_at (dir, dirname);
+}
+
+/**
+ * Like remove, but looks a relative path up from the directory open as dirfd.
+ * Returns false if dirfd is not an open directory.
+ */
+static bool
+sys_removeat (struct intr_frame *f)
+{
+  int dirfd = frame_arg_int (f, 1);
+  const char *filename = frame_arg_ptr (f, 2);
+  memory_verify_string (filename);
+
+  block_sector_t dir = fd_dir (dirfd);
+  if (dir == INODE_INVALID_BLOCK_SECTOR) return false;
+
+  return remove_at (dir, filename);
+}
+
 /* This function performs some file operation one page at a time so
    that we do not need to worry about having a frame removed from
    under us */
@@ -682,7 +938,7 @@ sys_mmap (struct intr_frame *f)
   struct process_fd *pfd = process_get_file (t, fd);
   if (pfd == NULL) return -1;
 
-  struct process_mmap *mmap = mmap_create (pfd->filename);
+  struct process_mmap *mmap = mmap_create (fd);
   if (mmap == NULL) return -1;
 
   /* Break file into pages, making sure to note the number of zeros
@@ -796,6 +1052,30 @@ syscall_handler (struct intr_frame *f)
   case SYS_INUMBER:
     eax = sys_inumber (f);
     break;
+  case SYS_CACHESTAT:
+    eax = sys_cachestat (f);
+    break;
+  case SYS_FSYNC:
+    eax = sys_fsync (f);
+    break;
+  case SYS_FALLOCATE:
+    eax = sys_fallocate (f);
+    break;
+  case SYS_READDIRPLUS:
+    eax = sys_readdirplus (f);
+    break;
+  case SYS_OPENAT:
+    eax = sys_openat (f);
+    break;
+  case SYS_CREATEAT:
+    eax = sys_createat (f);
+    break;
+  case SYS_MKDIRAT:
+    eax = sys_mkdirat (f);
+    break;
+  case SYS_REMOVEAT:
+    eax = sys_removeat (f);
+    break;
   case SYS_MMAP:
     eax = sys_mmap (f);
     break;
@@ -1,10 +1,14 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "devices/block.h"
+
 #define READDIR_MAX_LEN 14
 
 void syscall_init (void);
 void syscall_close (int fd);
 int syscall_open (const char *filename);
+int syscall_open_at (block_sector_t dir, const char *filename);
+int syscall_reopen (int fd);
 
 #endif /* userprog/syscall.h */